@@ -1,17 +1,74 @@
+// Server mode, the loaders and the benchmarks use POSIX and GNU extensions
+// (rwlock kinds, madvise, mkdtemp) that strict -std=c11 hides otherwise
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <stdarg.h>
+#include <float.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 // Define constants
-#define MAX_USERS 100
-#define MAX_PRODUCTS 100
-#define MAX_ORDERS 100
+#define POOL_CHUNK_SHIFT 12 // 4096 records per storage chunk
+#define POOL_CHUNK_SIZE (1 << POOL_CHUNK_SHIFT)
 #define FILENAME_USERS "users.txt"
 #define FILENAME_PRODUCTS "products.txt"
 #define FILENAME_ORDERS "orders.txt"
+#define FILENAME_REVIEWS "reviews.txt"
 #define FILENAME_ORDER_HISTORY "order_history.txt"
+#define FILENAME_HISTORY_INDEX "order_history.idx"
+#define FILENAME_CHANGE_LOG "changes.log"
+#define FILENAME_SNAPSHOT "data.snap"
+#define CHANGE_LOG_COMPACT_BYTES (4 * 1024 * 1024) // Write a new snapshot past this log size
+#define SNAPSHOT_VERSION 8
 #define PASSWORD_LENGTH 50
+#define SERVER_PORT 5050 // Default loopback port of server mode
+#define SERVER_THREADS 16 // Default number of session worker threads
+#define SERVER_QUEUE 64 // Accepted connections waiting for a worker
+#define RESERVATION_SECONDS (15 * 60) // How long a cart item holds its stock
+#define PAGE_SIZE 20 // Records shown per page of an interactive listing
+#define FILENAME_STATS "stats.json"
+#define STAT_BUCKETS 40 // Latency histogram buckets, powers of two in nanoseconds
+#define FILTER_BLOCK 4096 // Products filtered per pass of a columnar scan
+#define LOAD_CHUNK_BYTES (4 * 1024 * 1024) // Smallest slice of a text file given its own thread
+#define LOAD_MAX_THREADS 16
+#define TERM_LENGTH 24 // Longest indexed word, including the terminator; longer words are cut
+#define TYPO_MIN_LENGTH 4 // Shortest word matched with a typo
+#define TYPO_TERMS_MAX 32 // Words a query word may match through a typo
+#define QUERY_WORDS 8 // Words of a text query used; the rest are ignored
+#define TEXT_RESULTS_MAX 100 // Most products returned by one text search
+#define TOP_VIEW_SIZE 20 // Products a top list shows
+#define TOP_VIEW_CAPACITY (4 * TOP_VIEW_SIZE) // Entries a top list keeps in reserve
+#define PROBE_TERMS_MAX 16 // Past this many matching words a query word is checked against the text
+#define ANALYTICS_BLOCK_BYTES (1024 * 1024) // Order history read per call by a sales report thread
+#define ANALYTICS_TOP 10 // Products and customers listed in a sales report
+
+// Operation timing. Build with -DNO_STATS to compile it out entirely.
+#ifndef NO_STATS
+#define STAT_START() long long statStarted = statNow()
+#define STAT_RECORD(stat, bytes) statRecord(stat, statStarted, bytes)
+#else
+#define STAT_START()
+#define STAT_RECORD(stat, bytes)
+#endif
 
 // User structure
 typedef struct {
@@ -23,15 +80,49 @@ typedef struct {
 // Product structure
 typedef struct {
     char name[50];
-    char category[50];
+    int category; // Slot in categories, -1 for none
     float price;
     int stock;
     float discount; // Discount percentage
-    float rating;
-    char reviews[100];
+    float rating; // Mean rating of the product's reviews, 0 before the first
+    int reviewCount;
+    double ratingSum;
+    int latestReview; // Slot of the newest review in reviewPool, -1 for none
+    int deleted; // Removed products keep their slot so serial numbers stay stable
 } Product;
 
-// Order structure
+// Order status
+enum {
+    ORDER_PENDING, // In the user's cart
+    ORDER_PAID,
+    ORDER_CANCELLED // Dropped from the cart because its product is no longer sold
+};
+
+// Order structure. What an order refers to is stored as a number: the
+// customer and product are slots in their tables, and the address and
+// payment method are entries of the string dictionary.
+typedef struct {
+    int orderId;
+    int customer; // Slot in customers
+    int product; // Product slot
+    int quantity;
+    float totalPrice;
+    int address; // Dictionary entry
+    int paymentMethod; // Dictionary entry, -1 while pending
+    int status; // ORDER_PENDING, ORDER_PAID or ORDER_CANCELLED
+} Order;
+
+// A line of products.txt, which names the product's category
+typedef struct {
+    char name[50];
+    char category[50];
+    float price;
+    int stock;
+    float discount;
+    float rating;
+} ProductLine;
+
+// A line of orders.txt, which names everything the order refers to
 typedef struct {
     int orderId;
     char username[50];
@@ -40,26 +131,703 @@ typedef struct {
     float totalPrice;
     char address[100];
     char paymentMethod[20];
-} Order;
+} OrderLine;
+
+// An entry of the string dictionary, which stores each distinct address
+// and payment method once however many orders use it
+typedef struct {
+    char text[100];
+} DictionaryString;
+
+// Review structure. Reviews are only ever appended, and each links to the
+// previous review of its product, so a product's reviews can be paged
+// newest first without any per-product list.
+typedef struct {
+    int product; // Product slot
+    int previous; // Slot of the product's previous review, -1 for none
+    float rating;
+    char text[100];
+} Review;
+
+// A line of reviews.txt: the product is named rather than numbered, since
+// slots change when the text files are rewritten
+typedef struct {
+    char productName[50];
+    float rating;
+    char text[100];
+} ReviewLine;
+
+// Growable record storage. Records live in fixed-size chunks that are never
+// moved or freed, so growing only extends the chunk directory and any pointer
+// to a record stays valid for the lifetime of the program.
+typedef struct {
+    size_t recordSize;
+    char **chunks;
+    int chunkCount;
+    int chunkCapacity;
+} Pool;
+
+// Open-addressing hash index from a record's name to its slot. Buckets hold
+// only the hash and the slot, so a probe stays within a cache line or two and
+// the key string is compared only when the hashes already match.
+typedef struct {
+    unsigned int hash;
+    int slot; // -1 for an empty bucket
+} IndexEntry;
+
+typedef struct {
+    IndexEntry *entries;
+    int capacity; // always a power of two
+    int count;
+    const char *(*keyOf)(int slot);
+} NameIndex;
+
+// Array of (key, slot) pairs kept sorted by key, then slot, for range queries
+typedef struct {
+    float key;
+    int slot;
+} SortedEntry;
+
+typedef struct {
+    SortedEntry *entries;
+    int count;
+    int capacity;
+} SortedIndex;
+
+// A materialized top list: the best products by one key, lowest key first
+// and then by slot. It keeps up to TOP_VIEW_CAPACITY entries so products
+// dropping out of it seldom leave it short, and it is only rebuilt from
+// the products once fewer than TOP_VIEW_SIZE remain.
+typedef struct {
+    SortedEntry entries[TOP_VIEW_CAPACITY];
+    int count;
+    int complete; // Holds every product eligible for the list
+    int stale; // Has to be rebuilt before it is read
+} TopView;
+
+// Kinds of top list
+enum {
+    TOP_RATED,
+    TOP_SELLERS,
+    TOP_CHEAPEST // Per category, by price after discount
+};
+
+// A product category with its products ordered by price
+typedef struct {
+    char name[50];
+    SortedIndex products;
+    TopView cheapest;
+} Category;
+
+// Growable list of record slots
+typedef struct {
+    int *slots;
+    int count;
+    int capacity;
+} SlotList;
+
+// Orders placed by one user, with the unpaid cart items kept separately
+typedef struct {
+    char username[50];
+    SlotList orders;
+    SlotList pending;
+} CustomerOrders;
+
+// Columnar copy of the product fields that searches filter on, one entry
+// per product slot. A scan reads only the columns it compares, 4 bytes a
+// product each, instead of pulling in whole ~100-byte Product rows.
+typedef struct {
+    float *price;
+    float *finalPrice; // Price after discount
+    int *stock;
+    float *rating;
+    int *category; // Index into categories, -1 for deleted products
+    int count;
+    int capacity; // 0 while the columns point into the snapshot mapping
+} ProductColumns;
+
+// A filter over the product columns; see filterProducts
+typedef struct {
+    int category; // Category index, or -1 for any
+    int byFinalPrice; // Compare the price after discount
+    float minPrice;
+    float maxPrice;
+    float minRating;
+    int inStockOnly;
+} ProductFilter;
+
+// Text fields of a product, in increasing weight; a word found in one
+// counts field + 1 times towards the product's relevance
+enum {
+    FIELD_REVIEW,
+    FIELD_CATEGORY,
+    FIELD_NAME
+};
+
+// A word of the full-text index and where it occurs: each posting is a
+// product slot times 4 plus the field holding the word, and the postings
+// are kept in ascending order without repeats.
+typedef struct {
+    char text[TERM_LENGTH];
+    SlotList products;
+} Term;
+
+// One word of a text query. It matches the words it equals or begins; a
+// word that begins no indexed word matches those one typo away instead.
+typedef struct {
+    char text[TERM_LENGTH];
+    int length;
+    int first, last; // Range of termOrder holding the words it begins
+    int typo;
+    int typoTerms[TYPO_TERMS_MAX];
+    int typoTermCount;
+    long long postings; // Product slots listed under the words it matches
+} QueryWord;
+
+// Record parsers for the text data files: a scanner parses one record at
+// *cursor and advances it, a reader reads one with fscanf
+typedef int (*RecordScanner)(const char **cursor, const char *end, void *record);
+typedef int (*RecordReader)(FILE *file, void *record);
+
+// A slice of a mapped text file and the records parsed from it
+typedef struct {
+    const char *start;
+    const char *end;
+    RecordScanner scanner;
+    Pool *pool; // Where the records go, from index first on
+    int first;
+    int count;
+    const char *stopped; // Where parsing stopped; end if every record was read
+} TextChunk;
+
+// One of the independent loads run at startup
+typedef void (*LoadTask)();
+
+// Sections of the binary snapshot, in file order
+enum {
+    SECTION_USERS,
+    SECTION_USER_INDEX,
+    SECTION_PRODUCTS,
+    SECTION_ORDERS,
+    SECTION_REVIEWS,
+    SECTION_PRODUCT_INDEX,
+    SECTION_PRICE_INDEX,
+    SECTION_CATEGORIES,
+    SECTION_CATEGORY_INDEX,
+    SECTION_CATEGORY_ENTRIES,
+    SECTION_CUSTOMERS,
+    SECTION_CUSTOMER_INDEX,
+    SECTION_CUSTOMER_SLOTS,
+    SECTION_PRICE_COLUMN,
+    SECTION_FINAL_PRICE_COLUMN,
+    SECTION_STOCK_COLUMN,
+    SECTION_RATING_COLUMN,
+    SECTION_CATEGORY_COLUMN,
+    SECTION_STRINGS,
+    SECTION_STRING_INDEX,
+    SECTION_COUNT
+};
+
+// Binary snapshot header. Records are stored with their in-memory layout,
+// so the record sections can be mapped and used in place; the indexes are
+// stored as their raw arrays and only need a bulk copy on load.
+typedef struct {
+    char magic[8];
+    int version;
+    int userSize;
+    int productSize;
+    int orderSize;
+    int reviewSize;
+    int userCount;
+    int productCount;
+    int activeProductCount;
+    int orderCount;
+    int reviewCount;
+    int categoryCount;
+    int customerCount;
+    int userIndexCount;
+    int productIndexCount;
+    int priceIndexCount;
+    int stringCount;
+    int lastOrderId;
+    int logGeneration;
+    long long offset[SECTION_COUNT];
+    long long size[SECTION_COUNT];
+} SnapshotHeader;
 
-// Global arrays to store users, products, and orders
-User users[MAX_USERS];
-Product products[MAX_PRODUCTS];
-Order orders[MAX_ORDERS];
+// Per-category and per-user list headers in the snapshot; their entries
+// follow back to back in the matching entries section
+typedef struct {
+    char name[50];
+    int count;
+} SnapshotCategory;
+
+typedef struct {
+    char username[50];
+    int orderCount;
+    int pendingCount;
+} SnapshotCustomer;
+
+// One entry of the order history index: where a history line starts, how
+// long it is, and the order ID and time it was written. Entries are appended
+// in the same order as the lines, so both orderId and timestamp ascend and
+// the file can be binary searched in place.
+typedef struct {
+    int orderId;
+    int length;
+    long long offset;
+    long long timestamp;
+} HistoryIndexEntry;
+
+// Orders, units and revenue of the history lines sharing one key
+typedef struct {
+    char key[50];
+    unsigned int hash;
+    long long orders; // 0 marks an empty bucket
+    long long units;
+    long long cents;
+} SalesTotal;
+
+// Open-addressing table of sales totals; capacity is a power of two
+typedef struct {
+    SalesTotal *entries;
+    int capacity;
+    int count;
+} SalesTable;
+
+// One parsed order history line
+typedef struct {
+    char date[20]; // Empty on lines written before dates were recorded
+    char username[50];
+    char productName[50];
+    char paymentMethod[20];
+    int quantity;
+    long long cents;
+} HistoryLine;
+
+// Sales totals over the order history, or over one slice of it
+typedef struct {
+    SalesTable products;
+    SalesTable users;
+    SalesTable methods;
+    SalesTable days;
+    long long lines;
+    long long skipped; // Lines that are not order lines
+    long long orders;
+    long long units;
+    long long cents;
+    long long baskets;
+    int threads;
+    long long bytes;
+    double seconds;
+} SalesReport;
+
+// The part of the history file one sales report thread reads: the lines
+// starting in [start, end)
+typedef struct {
+    long long start;
+    long long end;
+    SalesReport report;
+    char firstBasket[72]; // Date and user of the first and last orders read
+    char lastBasket[72];
+    int failed;
+} HistorySlice;
+
+// One product's share of a cart during checkout
+typedef struct {
+    int slot;
+    int quantity;
+    int held; // Part of quantity already reserved by the cart
+} CartLine;
+
+// Stock set aside for one cart item until checkout or until it expires
+typedef struct {
+    int product; // Product slot
+    int quantity; // 0 once converted or released
+    time_t expires;
+} Reservation;
+
+// When change log records are forced to disk
+enum {
+    SYNC_NONE, // Never; the system writes them back in its own time
+    SYNC_ALWAYS, // Each record on its own, as it is written
+    SYNC_GROUP // Before the command that wrote it is answered, sharing one fsync with every record written by then
+};
+
+// Result codes of the operations shared by the menus and batch mode
+enum {
+    RESULT_OK,
+    RESULT_NOT_FOUND,
+    RESULT_EXISTS,
+    RESULT_INVALID,
+    RESULT_NO_STOCK,
+    RESULT_EMPTY,
+    RESULT_DENIED
+};
+
+// Growable text buffer for batch responses
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+// Login state of one batch session
+typedef struct {
+    char username[50];
+    int loggedIn;
+    int isAdmin;
+} Session;
+
+// Instrumented operations
+enum {
+    STAT_LOAD_USERS,
+    STAT_LOAD_PRODUCTS,
+    STAT_LOAD_ORDERS,
+    STAT_LOAD_SNAPSHOT,
+    STAT_REPLAY_LOG,
+    STAT_SAVE_USERS,
+    STAT_SAVE_PRODUCTS,
+    STAT_SAVE_ORDERS,
+    STAT_SAVE_HISTORY,
+    STAT_SAVE_SNAPSHOT,
+    STAT_LOG_CHANGE,
+    STAT_SYNC_LOG,
+    STAT_SEARCH,
+    STAT_FILTER,
+    STAT_TEXT_SEARCH,
+    STAT_LOGIN,
+    STAT_ADD_TO_CART,
+    STAT_CHECKOUT,
+    STAT_REVIEW,
+    STAT_COUNT
+};
+
+// Counters and latency histogram of one operation. Bucket i counts calls
+// that took [2^i, 2^(i+1)) nanoseconds. Updated with relaxed atomics so
+// server sessions can record concurrently.
+typedef struct {
+    long long calls;
+    long long bytes; // Read by loads, written by saves
+    long long totalNanos;
+    long long maxNanos;
+    long long buckets[STAT_BUCKETS];
+} OperationStats;
+
+const char *statNames[STAT_COUNT] = {
+    "load_users", "load_products", "load_orders", "load_snapshot", "replay_log",
+    "save_users", "save_products", "save_orders", "save_history", "save_snapshot",
+    "log_change", "sync_log", "search", "filter", "text_search", "login", "add_to_cart", "checkout", "review"
+};
+OperationStats operationStats[STAT_COUNT];
+
+// Interactive listings are formatted here and written with one call
+Buffer screen = {NULL, 0, 0};
+
+// Global pools to store users, products, orders and reviews
+Pool userPool = {sizeof(User), NULL, 0, 0};
+Pool productPool = {sizeof(Product), NULL, 0, 0};
+Pool orderPool = {sizeof(Order), NULL, 0, 0};
+Pool reviewPool = {sizeof(Review), NULL, 0, 0};
 int userCount = 0;
-int productCount = 0;
+int productCount = 0;        // Product slots in use, including deleted ones
+int activeProductCount = 0;  // Products not deleted
+int tombstoneCount = 0;      // Deleted products still listed in the search indexes
 int orderCount = 0;
+int reviewCount = 0;
 int lastOrderId = 0;
 int lastSavedOrderId = 0;  // Track the last order ID assigned
 
+// Stock reservations. Each product slot has a hold counter, changed with
+// atomic compare-and-swap so carts for different products (or the same
+// one) never wait on a lock to reserve; each order slot has the
+// reservation its cart item holds. Neither is saved: after a restart,
+// checkout checks unreserved items against the free stock.
+Pool holdPool = {sizeof(int), NULL, 0, 0};
+Pool reservationPool = {sizeof(Reservation), NULL, 0, 0};
+int holdCount = 0;
+int reservationCount = 0;
+SlotList reservedOrders = {NULL, 0, 0}; // Order slots that may still hold stock
+time_t lastReservationSweep = 0;
+#ifndef _WIN32
+// Serializes order appends (and the change log) between sessions that
+// otherwise share the store lock in server mode. Add-to-cart grows the
+// order pool, the customers table and the string dictionary under it, so
+// shared-lock commands that read those (orders) must hold it as well.
+pthread_mutex_t orderLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+const char *userKey(int slot);
+NameIndex userIndex = {NULL, 0, 0, userKey};
+SlotList duplicateUsers = {NULL, 0, 0}; // Accounts named like an earlier one in users.txt
+const char *productKey(int slot);
+NameIndex productIndex = {NULL, 0, 0, productKey};
+
+// Secondary indexes used by searchProducts
+const char *categoryKey(int slot);
+Category *categories = NULL;
+int categoryCount = 0;
+int categoryCapacity = 0;
+NameIndex categoryIndex = {NULL, 0, 0, categoryKey};
+SortedIndex priceIndex = {NULL, 0, 0};
+ProductColumns productColumns = {NULL, NULL, NULL, NULL, NULL, 0, 0};
+TopView topRated = {{{0, 0}}, 0, 0, 1};
+TopView bestSellers = {{{0, 0}}, 0, 0, 1};
+Pool salesPool = {sizeof(int), NULL, 0, 0}; // Units of each product in paid orders
+int salesCount = 0;
+int salesCounted = 0; // salesPool is filled in on the first best seller list
+int simdLevel = -1; // 0 scalar, 1 SSE2, 2 AVX2; chosen on first use
+int loadThreads = 0; // Threads parsing a text file; 0 for one per CPU, -1 for fscanf only
+
+// Full-text index over product names, categories and review text. It is
+// built on the first text search and kept up to date from then on.
+const char *termKey(int slot);
+Term *terms = NULL;
+int termCount = 0;
+int termCapacity = 0;
+NameIndex termIndex = {NULL, 0, 0, termKey};
+int *termOrder = NULL; // Term slots sorted by text, for prefix matches
+NameIndex typoIndex = {NULL, 0, 0, termKey}; // Each word's one-letter deletions; see findTypoTerms
+int textIndexReady = 0;
+
+// Append-only log of changes made since the data files were last written.
+// Between beginChangeBatch and endChangeBatch records are collected in
+// changeBatch and written out together.
+FILE *changeLog = NULL;
+long changeLogBytes = 0;
+// Bumped by every compaction. The log starts with the generation it was
+// opened in and the snapshot stores the one it was saved in, so a log
+// the snapshot already holds is never replayed on top of it.
+int logGeneration = 0;
+char *changeBatch = NULL;
+int changeBatchLength = 0;
+int changeBatchCapacity = 0;
+int changeBatchOpen = 0;
+
+// Durability of the change log; see waitForCommit. Records are numbered in
+// the order they are written, batches counting as one.
+int syncPolicy = SYNC_GROUP;
+int syncWindow = 1000; // Microseconds a group fsync may wait for running commands to log their changes
+int commitsDeferred = 0; // Set when callers wait for their commits themselves, after releasing storeLock
+int compactionDeferred = 0; // Set when callers compact the change log themselves, holding storeLock exclusively
+long long changeSequence = 0; // Records written to the change log
+long long changeDurable = 0; // Records known to be on disk
+long long changeSyncs = 0; // fsync calls made for the change log
+int changeSyncRunning = 0;
+int commandsRunning = 0; // Server commands started and not yet finished
+#ifndef _WIN32
+pthread_mutex_t syncLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t changeSynced = PTHREAD_COND_INITIALIZER;
+pthread_cond_t commandsProgressed = PTHREAD_COND_INITIALIZER;
+#endif
+
+// Per-user order index used by the user panel and checkout
+const char *customerKey(int slot);
+CustomerOrders *customers = NULL;
+int customerCount = 0;
+int customerCapacity = 0;
+NameIndex customerIndex = {NULL, 0, 0, customerKey};
+
+// String dictionary holding the addresses and payment methods of orders
+const char *stringAt(int id);
+Pool dictionaryPool = {sizeof(DictionaryString), NULL, 0, 0};
+int dictionaryCount = 0;
+NameIndex dictionaryIndex = {NULL, 0, 0, stringAt};
+NameIndex retiredProductIndex = {NULL, 0, 0, productKey}; // Deleted records made for orders of unknown products
+
+// Order lines read by loadOrders, waiting for resolveOrders
+Pool orderLinePool = {sizeof(OrderLine), NULL, 0, 0};
+int orderLineCount = 0;
+
 // Function prototypes
+void *poolReserve(Pool *pool, int index);
+User *userAt(int index);
+Product *productAt(int index);
+Order *orderAt(int index);
+Review *reviewAt(int index);
+unsigned int hashString(const char *key);
+int indexProbe(NameIndex *index, const char *key, unsigned int hash);
+void indexResize(NameIndex *index, int capacity);
+int indexFind(NameIndex *index, const char *key);
+void indexInsert(NameIndex *index, const char *key, int slot);
+void indexRemove(NameIndex *index, const char *key);
+void indexSetSlot(NameIndex *index, const char *key, int slot);
+int findUser(const char *username);
+int findProduct(const char *name);
+void deleteProductAt(int index);
+int sortedLowerBound(SortedIndex *index, float key, int slot);
+void sortedAppend(SortedIndex *index, float key, int slot);
+void sortedInsert(SortedIndex *index, float key, int slot);
+void sortedRemove(SortedIndex *index, float key, int slot);
+void sortedFinish(SortedIndex *index);
+void compactSearchIndexes();
+int getProductSerial(const char *prompt, int min);
+Category *findCategory(const char *name, int create);
+int categoryId(const char *name);
+void buildSearchIndexes();
+void indexProductForSearch(int slot);
+void unindexProductForSearch(int slot);
+int findMatchingProducts(const char *category, int byPrice, float minPrice, float maxPrice, int **results);
+int scanMatchingProducts(const char *category, int byPrice, float minPrice, float maxPrice, int **results);
+void printSearchResults(int *results, int count, int showCategory);
+int *productSales(int slot);
+void countSales();
+int topViewKey(int kind, int slot, float *key);
+void topViewInsert(TopView *view, float key, int slot);
+void topViewRemove(TopView *view, int slot);
+void topViewUpdate(TopView *view, int slot, int eligible, float key);
+void updateTopViews(int slot);
+void rebuildTopView(TopView *view, int kind, Category *category);
+int topProducts(int kind, const char *category, int k, int *results);
+int nextWord(const char **cursor, char *word);
+int termLowerBound(const char *word);
+void typoInsert(unsigned int hash, int term);
+int findTerm(const char *word);
+void insertPosting(SlotList *products, int posting);
+void indexText(int slot, int field, const char *text);
+void clearTextIndex();
+void buildTextIndex();
+int withinOneEdit(const char *a, int aLength, const char *b, int bLength);
+void addTypoTerm(QueryWord *word, int term);
+void findTypoTerms(QueryWord *word);
+int matchField(const QueryWord *word, const char *text);
+int postingRelevance(const QueryWord *word, int slot);
+int scoreProduct(int slot, QueryWord *words, int wordCount, int skip);
+int searchText(const char *query, int limit, int *results);
+void growProductColumns(int count);
+void syncProductColumns(int slot);
+void buildProductColumns();
+int detectSimdLevel();
+int selectFloatRange(const float *column, int count, float low, float high, int *selection);
+int selectIntEqual(const int *column, int count, int value, int *selection);
+int filterProducts(const ProductFilter *filter, int **results);
+void renderProduct(Buffer *out, int slot, int showCategory);
+void renderOrder(Buffer *out, Order *order);
+void flushScreen();
+int askNextPage(int shown, int total);
+void slotListAppend(SlotList *list, int slot);
+CustomerOrders *findCustomerOrders(const char *username, int create);
+int internString(const char *text);
+int orderProductSlot(const char *name);
+void orderFromLine(OrderLine *line, Order *order);
+const char *orderMethod(Order *order);
+void indexOrder(int slot);
+void dropPending(CustomerOrders *customer, int slot);
+int dropStaleCartItems(CustomerOrders *customer, int report);
+int collectCartLines(CustomerOrders *customer, CartLine **lines, int report);
+int commitCheckout(CustomerOrders *customer, const char *paymentMethod);
+void lockOrders();
+void unlockOrders();
+void coverReservations();
+int *productHold(int slot);
+Reservation *reservationAt(int slot);
+int availableStock(int slot);
+int reserveStock(int slot, int quantity);
+void releaseExpiredReservations();
+double nowSeconds();
+int runBenchmark(int argc, char *argv[]);
+int generateDataset(int users, int products, int orders);
+int runGenerate(int argc, char *argv[]);
+int runAnalytics(int argc, char *argv[]);
+int isScanSpace(char c);
+const char *skipBlanks(const char *p, const char *end);
+int scanWord(const char **cursor, const char *end, char *out, int width);
+int scanInt(const char **cursor, const char *end, int *value);
+int scanFloat(const char **cursor, const char *end, float *value);
+int scanText(const char **cursor, const char *end, char *out, int width);
+int scanUser(const char **cursor, const char *end, void *record);
+int scanProduct(const char **cursor, const char *end, void *record);
+int scanOrder(const char **cursor, const char *end, void *record);
+int readUser(FILE *file, void *record);
+int readProduct(FILE *file, void *record);
+int readOrder(FILE *file, void *record);
+int scanReviewLine(const char **cursor, const char *end, void *record);
+int readReviewLine(FILE *file, void *record);
+void *scanTextChunk(void *arg);
+long long loadTextRecords(const char *filename, Pool *pool, int *count, RecordScanner scanner, RecordReader reader);
 void loadUsers();
 void saveUsers();
 void loadProducts();
 void saveProducts();
 void loadOrders();
+void resolveOrders();
 void saveOrders();
+void loadReviews();
+void saveReviews();
+void migrateProductReviews();
 void saveOrderHistory();
+void loadLastSavedOrderId();
+int historyEntryCount(FILE *index);
+int readHistoryEntry(FILE *index, int position, HistoryIndexEntry *entry);
+void printHistoryEntries(FILE *index, int first, int last);
+SalesTotal *salesTotalFor(SalesTable *table, const char *key);
+void addSale(SalesTable *table, const char *key, int quantity, long long cents);
+int takeHistoryField(const char **cursor, const char *end, const char *label, char *out, int width);
+int parseHistoryLine(const char *p, const char *end, HistoryLine *line);
+void addHistoryLine(HistorySlice *slice, const char *start, const char *end);
+void *analyzeHistorySlice(void *arg);
+void mergeSalesTable(SalesTable *into, SalesTable *from);
+int analyzeHistory(int threads, SalesReport *report);
+void formatSalesTable(Buffer *out, const char *title, SalesTable *table, int limit, int (*compare)(const void *, const void *));
+void formatSalesReport(Buffer *out, SalesReport *report);
+void freeSalesReport(SalesReport *report);
+void *loadTaskWorker(void *arg);
+void runConcurrently(LoadTask *tasks, int count);
+void checkCrossReferences();
+void loadData();
+int loadSnapshot();
+int saveSnapshot();
+void importTextFiles();
+void exportTextFiles();
+void openChangeLog();
+void logChange(const char *format, ...);
+void beginChangeBatch();
+void endChangeBatch();
+void replayChangeLog();
+void compactChangeLog();
+void compactChangeLogIfDue();
+void changeLogWritten();
+void waitForCommit(long long sequence);
+long long commandStarted();
+long long commandFinished();
+int parseSyncOption(const char *option);
+FILE *openReplacement(const char *path, const char *mode);
+int replaceFile(FILE *file, const char *path, int ok);
+void appendUser(User *user);
+void appendProduct(Product *product);
+void appendOrder(Order *order);
+int findOrder(int orderId);
+int isLiveProduct(int slot);
+int createUser(const char *username, const char *password);
+int authenticateUser(const char *username, const char *password);
+int createProduct(const char *name, const char *category, float price, int stock, float discount, int *slot);
+int removeProductAt(int slot);
+int setProductDiscount(int slot, float discount);
+int placeInCart(const char *username, int slot, int quantity, const char *address, int *orderId);
+int checkoutCart(const char *username, const char *paymentMethod, int *items, float *total);
+int findUserOrder(const char *username, int orderId);
+int addReview(int slot, float rating, const char *text);
+const char *latestReviewText(int slot);
+int pageReviews(int slot, int before, int limit, int *page);
+int reviewProduct(int slot, float rating, const char *text);
+void bufferPrintf(Buffer *buffer, const char *format, ...);
+long long statNow();
+void statRecord(int stat, long long started, long long bytes);
+long long statPercentile(OperationStats *stats, double fraction);
+void formatStats(Buffer *out, int json);
+void showStats();
+void writeStatsFile();
+void startStatsSignalThread();
+const char *resultReason(int result);
+char *nextToken(char **line);
+char *restOfLine(char **line);
+int parseInteger(const char *token, int *value);
+int parseFloat(const char *token, float *value);
+void bufferProduct(Buffer *out, int slot);
+void executeCommand(Session *session, char *line, Buffer *out);
+int runBatch(const char *path);
+int isSharedCommand(const char *line);
+int runServer(int argc, char *argv[]);
 void registerUser();
 int loginUser(char *username);
 void adminPanel();
@@ -74,6 +842,8 @@ void addToCart(char *username);
 void checkout(char *username);
 void updateStock(char *productName, int quantity);
 void provideRatingAndReview(char *username);
+void viewProductReviews();
+void viewTopProducts();
 void clearCart(char *username);
 int validateMobileNumber(char *number);
 int getIntegerInput(const char *prompt, int min, int max);
@@ -81,10 +851,51 @@ float getFloatInput(const char *prompt, float min, float max);
 void displayUserOrders(char *username);
 
 // Main function
-int main() {
-    loadUsers();
-    loadProducts();
-    loadOrders();
+int main(int argc, char *argv[]) {
+    startStatsSignalThread();
+
+    // Options come before the mode: --sync=POLICY, --sync-window=MICROSECONDS
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (!parseSyncOption(argv[1])) {
+            printf("Usage: project [--sync=none|always|group] [--sync-window=MICROSECONDS] [mode] [args...]\n");
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return runBenchmark(argc - 2, argv + 2);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "generate") == 0) {
+        return runGenerate(argc - 2, argv + 2);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "analytics") == 0) {
+        return runAnalytics(argc - 2, argv + 2);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        return runBatch(argc > 2 ? argv[2] : NULL);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return runServer(argc - 2, argv + 2);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "import") == 0) {
+        importTextFiles();
+        return 0;
+    }
+
+    loadData();
+    if (argc > 1 && strcmp(argv[1], "export") == 0) {
+        exportTextFiles();
+        return 0;
+    }
+    openChangeLog();
 
     int choice;
     do {
@@ -110,6 +921,8 @@ int main() {
                 break;
             }
             case 3:
+                compactChangeLog();
+                writeStatsFile();
                 printf("Exiting...\n");
                 break;
         }
@@ -152,716 +965,6036 @@ float getFloatInput(const char *prompt, float min, float max) {
     }
 }
 
-// Load users from file
-void loadUsers() {
-    FILE *file = fopen(FILENAME_USERS, "r");
-    if (file == NULL) {
-        printf("No user data found. Starting with an empty list.\n");
-        return;
-    }
-    while (fscanf(file, "%49s %49s %d", users[userCount].username, users[userCount].password, &users[userCount].isAdmin) == 3) {
-        userCount++;
-        if (userCount >= MAX_USERS) break;
+// Make sure the record at index has backing storage and return it
+void *poolReserve(Pool *pool, int index) {
+    int chunk = index >> POOL_CHUNK_SHIFT;
+    while (chunk >= pool->chunkCount) {
+        if (pool->chunkCount == pool->chunkCapacity) {
+            // Only the directory of chunk pointers is reallocated; records stay put
+            int newCapacity = pool->chunkCapacity ? pool->chunkCapacity * 2 : 16;
+            char **chunks = realloc(pool->chunks, newCapacity * sizeof(char *));
+            if (chunks == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            pool->chunks = chunks;
+            pool->chunkCapacity = newCapacity;
+        }
+        pool->chunks[pool->chunkCount] = malloc(POOL_CHUNK_SIZE * pool->recordSize);
+        if (pool->chunks[pool->chunkCount] == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        pool->chunkCount++;
     }
-    fclose(file);
+    return pool->chunks[chunk] + (size_t)(index & (POOL_CHUNK_SIZE - 1)) * pool->recordSize;
 }
 
-// Save users to file
-void saveUsers() {
-    FILE *file = fopen(FILENAME_USERS, "w");
-    if (file == NULL) {
-        printf("Error saving user data.\n");
-        return;
-    }
-    for (int i = 0; i < userCount; i++) {
-        fprintf(file, "%s %s %d\n", users[i].username, users[i].password, users[i].isAdmin);
-    }
-    fclose(file);
+// Record accessors (index must be below the matching count)
+User *userAt(int index) {
+    return (User *)(userPool.chunks[index >> POOL_CHUNK_SHIFT] + (size_t)(index & (POOL_CHUNK_SIZE - 1)) * sizeof(User));
 }
 
-// Load products from file
-void loadProducts() {
-    FILE *file = fopen(FILENAME_PRODUCTS, "r");
-    if (file == NULL) {
-        printf("No product data found. Starting with an empty list.\n");
-        return;
-    }
-    while (fscanf(file, "%49s %49s %f %d %f %f %99[^\n]",
-           products[productCount].name,
-           products[productCount].category,
-           &products[productCount].price,
-           &products[productCount].stock,
-           &products[productCount].discount,
-           &products[productCount].rating,
-           products[productCount].reviews) == 7) {
-        productCount++;
-        if (productCount >= MAX_PRODUCTS) break;
-    }
-    fclose(file);
+Product *productAt(int index) {
+    return (Product *)(productPool.chunks[index >> POOL_CHUNK_SHIFT] + (size_t)(index & (POOL_CHUNK_SIZE - 1)) * sizeof(Product));
 }
 
-// Save products to file
-void saveProducts() {
-    FILE *file = fopen(FILENAME_PRODUCTS, "w");
-    if (file == NULL) {
-        printf("Error saving product data.\n");
-        return;
-    }
-    for (int i = 0; i < productCount; i++) {
-        fprintf(file, "%s %s %.2f %d %.2f %.2f %s\n",
-                products[i].name,
-                products[i].category,
-                products[i].price,
-                products[i].stock,
-                products[i].discount,
-                products[i].rating,
-                products[i].reviews);
-    }
-    fclose(file);
+Order *orderAt(int index) {
+    return (Order *)(orderPool.chunks[index >> POOL_CHUNK_SHIFT] + (size_t)(index & (POOL_CHUNK_SIZE - 1)) * sizeof(Order));
 }
 
-// Load orders from file
-void loadOrders() {
-    FILE *file = fopen(FILENAME_ORDERS, "r");
-    if (file == NULL) {
-        printf("No order data found. Starting with an empty list.\n");
-        return;
+Review *reviewAt(int index) {
+    return (Review *)(reviewPool.chunks[index >> POOL_CHUNK_SHIFT] + (size_t)(index & (POOL_CHUNK_SIZE - 1)) * sizeof(Review));
+}
+
+// FNV-1a hash of a string
+unsigned int hashString(const char *key) {
+    unsigned int hash = 2166136261u;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
     }
-    while (fscanf(file, "%d %49s %49s %d %f %19s %99[^\n]",
-           &orders[orderCount].orderId,
-           orders[orderCount].username,
-           orders[orderCount].productName,
-           &orders[orderCount].quantity,
-           &orders[orderCount].totalPrice,
-           orders[orderCount].paymentMethod,
-           orders[orderCount].address) == 7) {
-        if (orders[orderCount].orderId > lastOrderId) {
-            lastOrderId = orders[orderCount].orderId;
+    return hash;
+}
+
+// Find the bucket holding key, or the empty bucket where it would go
+int indexProbe(NameIndex *index, const char *key, unsigned int hash) {
+    int mask = index->capacity - 1;
+    int i = hash & mask;
+    while (index->entries[i].slot != -1) {
+        if (index->entries[i].hash == hash && strcmp(index->keyOf(index->entries[i].slot), key) == 0) {
+            break;
         }
-        orderCount++;
-        if (orderCount >= MAX_ORDERS) break;
+        i = (i + 1) & mask;
     }
-    fclose(file);
+    return i;
+}
 
-    // Also load the last saved order ID from history file
-    FILE *historyFile = fopen(FILENAME_ORDER_HISTORY, "r");
-    if (historyFile != NULL) {
-        char line[500];
-        int maxId = 0;
-        while (fgets(line, sizeof(line), historyFile)) {
-            int id;
-            if (sscanf(line, "Order ID: %d", &id) == 1) {
-                if (id > maxId) {
-                    maxId = id;
-                }
+// Rebuild the bucket array at a new capacity
+void indexResize(NameIndex *index, int capacity) {
+    IndexEntry *old = index->entries;
+    int oldCapacity = index->capacity;
+
+    index->entries = malloc(capacity * sizeof(IndexEntry));
+    if (index->entries == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    index->capacity = capacity;
+    for (int i = 0; i < capacity; i++) {
+        index->entries[i].slot = -1;
+    }
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].slot != -1) {
+            int j = old[i].hash & (capacity - 1);
+            while (index->entries[j].slot != -1) {
+                j = (j + 1) & (capacity - 1);
             }
+            index->entries[j] = old[i];
         }
-        lastSavedOrderId = maxId;
-        fclose(historyFile);
     }
+    free(old);
 }
 
-// Save orders to file
-void saveOrders() {
-    FILE *file = fopen(FILENAME_ORDERS, "w");
-    if (file == NULL) {
-        printf("Error saving order data.\n");
-        return;
-    }
-    for (int i = 0; i < orderCount; i++) {
-        fprintf(file, "%d %s %s %d %.2f %s %s\n",
-                orders[i].orderId,
-                orders[i].username,
-                orders[i].productName,
-                orders[i].quantity,
-                orders[i].totalPrice,
-                orders[i].paymentMethod,
-                orders[i].address);
-    }
-    fclose(file);
+// Look up the slot stored for key, or -1 if it is not indexed
+int indexFind(NameIndex *index, const char *key) {
+    if (index->count == 0) return -1;
+    return index->entries[indexProbe(index, key, hashString(key))].slot;
 }
 
-// Save order history to file
-void saveOrderHistory() {
-    FILE *file = fopen(FILENAME_ORDER_HISTORY, "a");
-    if (file == NULL) {
-        printf("Error saving order history.\n");
-        return;
+// Index key at slot; an existing entry for the same key is kept
+void indexInsert(NameIndex *index, const char *key, int slot) {
+    // Keep the load factor at or below one half
+    if ((index->count + 1) * 2 > index->capacity) {
+        indexResize(index, index->capacity ? index->capacity * 2 : 64);
+    }
+    unsigned int hash = hashString(key);
+    int i = indexProbe(index, key, hash);
+    if (index->entries[i].slot == -1) {
+        index->entries[i].hash = hash;
+        index->entries[i].slot = slot;
+        index->count++;
     }
+}
 
-    for (int i = 0; i < orderCount; i++) {
-        // Only save orders that haven't been saved to history yet
-        if (orders[i].orderId > lastSavedOrderId) {
-            fprintf(file, "Order ID: %d, User: %s, Product: %s, Qty: %d, Total: %.2f, Method: %s, Address: %s\n",
-                    orders[i].orderId,
-                    orders[i].username,
-                    orders[i].productName,
-                    orders[i].quantity,
-                    orders[i].totalPrice,
-                    orders[i].paymentMethod,
-                    orders[i].address);
+// Drop key from the index, shifting later entries of its probe run back
+void indexRemove(NameIndex *index, const char *key) {
+    if (index->count == 0) return;
+    int mask = index->capacity - 1;
+    int i = indexProbe(index, key, hashString(key));
+    if (index->entries[i].slot == -1) return;
 
-            // Update the last saved order ID
-            if (orders[i].orderId > lastSavedOrderId) {
-                lastSavedOrderId = orders[i].orderId;
-            }
+    int j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (index->entries[j].slot == -1) break;
+        // Move entry j into the hole unless its home bucket lies in (i, j]
+        int home = index->entries[j].hash & mask;
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            index->entries[i] = index->entries[j];
+            i = j;
         }
     }
-
-    fclose(file);
+    index->entries[i].slot = -1;
+    index->count--;
 }
-// Register a new user
-void registerUser() {
-    if (userCount >= MAX_USERS) {
-        printf("User limit reached. Cannot register more users.\n");
-        return;
+
+// Point an indexed key at a different slot (used when records move)
+void indexSetSlot(NameIndex *index, const char *key, int slot) {
+    if (index->count == 0) return;
+    int i = indexProbe(index, key, hashString(key));
+    if (index->entries[i].slot != -1) {
+        index->entries[i].slot = slot;
     }
+}
 
-    User newUser;
-    printf("Enter username (max 49 chars): ");
-    scanf("%49s", newUser.username);
+// Key accessor for the product name index
+const char *productKey(int slot) {
+    return productAt(slot)->name;
+}
 
-    // Check if username already exists
-    for (int i = 0; i < userCount; i++) {
-        if (strcmp(users[i].username, newUser.username) == 0) {
-            printf("Username already exists.\n");
-            return;
-        }
-    }
+// Key accessor for the username index
+const char *userKey(int slot) {
+    return userAt(slot)->username;
+}
 
-    printf("Enter password (max %d chars): ", PASSWORD_LENGTH-1);
-    scanf("%49s", newUser.password);
-    newUser.isAdmin = 0;
+// Find a user by name, returning the first account of that name or -1
+int findUser(const char *username) {
+    return indexFind(&userIndex, username);
+}
 
-    users[userCount++] = newUser;
-    saveUsers();
-    printf("User registered successfully!\n");
+// Find a product by name, returning its index or -1
+int findProduct(const char *name) {
+    return indexFind(&productIndex, name);
 }
 
-// Login a user
-int loginUser(char *username) {
-    char password[PASSWORD_LENGTH];
-    printf("Enter username: ");
-    scanf("%49s", username);
-    printf("Enter password: ");
-    scanf("%49s", password);
+// Store a new user
+void appendUser(User *user) {
+    *(User *)poolReserve(&userPool, userCount) = *user;
+    indexInsert(&userIndex, userAt(userCount)->username, userCount);
+    userCount++;
+}
 
-    // Check for fixed admin credentials
-    if (strcmp(username, "admin") == 0 && strcmp(password, "MATRF") == 0) {
-        printf("Admin login successful!\n");
-        return 1;
-    }
+// Store a new product and add it to every product index
+void appendProduct(Product *product) {
+    *(Product *)poolReserve(&productPool, productCount) = *product;
+    indexInsert(&productIndex, product->name, productCount);
+    indexProductForSearch(productCount);
+    productCount++;
+    activeProductCount++;
+    coverReservations();
+}
 
-    // Check for regular users
-    for (int i = 0; i < userCount; i++) {
-        if (strcmp(users[i].username, username) == 0 &&
-            strcmp(users[i].password, password) == 0) {
-            printf("Login successful!\n");
-            return 0;
-        }
+// Store a new order and add it to its user's lists
+void appendOrder(Order *order) {
+    *(Order *)poolReserve(&orderPool, orderCount) = *order;
+    indexOrder(orderCount);
+    orderCount++;
+    if (order->orderId > lastOrderId) {
+        lastOrderId = order->orderId;
     }
+    coverReservations();
+}
 
-    printf("Invalid username or password.\n");
-    return -1;
+// Serialize order appends between server sessions
+void lockOrders() {
+#ifndef _WIN32
+    pthread_mutex_lock(&orderLock);
+#endif
 }
 
-// Admin panel
-void adminPanel() {
-    int choice;
-    do {
-        printf("\nAdmin Panel\n");
+void unlockOrders() {
+#ifndef _WIN32
+    pthread_mutex_unlock(&orderLock);
+#endif
+}
+
+// Give every product a hold counter and every order a reservation
+void coverReservations() {
+    while (holdCount < productCount) {
+        *(int *)poolReserve(&holdPool, holdCount++) = 0;
+    }
+    while (reservationCount < orderCount) {
+        Reservation *reservation = poolReserve(&reservationPool, reservationCount++);
+        memset(reservation, 0, sizeof(Reservation));
+    }
+}
+
+// Stock of the product in slot reserved by carts
+int *productHold(int slot) {
+    return (int *)(holdPool.chunks[slot >> POOL_CHUNK_SHIFT] + (size_t)(slot & (POOL_CHUNK_SIZE - 1)) * sizeof(int));
+}
+
+// Reservation held by the order in slot
+Reservation *reservationAt(int slot) {
+    return (Reservation *)(reservationPool.chunks[slot >> POOL_CHUNK_SHIFT] + (size_t)(slot & (POOL_CHUNK_SIZE - 1)) * sizeof(Reservation));
+}
+
+// Stock of the product in slot that no cart has reserved
+int availableStock(int slot) {
+    return productAt(slot)->stock - __atomic_load_n(productHold(slot), __ATOMIC_ACQUIRE);
+}
+
+// Reserve quantity of the product in slot. Stock only changes under the
+// exclusive store lock, so a compare-and-swap on the hold counter is
+// enough to keep holds within stock. Returns 1 on success.
+int reserveStock(int slot, int quantity) {
+    int *hold = productHold(slot);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int held = __atomic_load_n(hold, __ATOMIC_ACQUIRE);
+        while (productAt(slot)->stock - held >= quantity) {
+            if (__atomic_compare_exchange_n(hold, &held, held + quantity, 1,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return 1;
+            }
+        }
+        // Out of stock: expired carts may be holding some of it
+        releaseExpiredReservations();
+    }
+    return 0;
+}
+
+// Give back stock held by cart items whose reservation has run out. Runs
+// at most once a second, since sold-out products would otherwise sweep on
+// every attempt.
+void releaseExpiredReservations() {
+    lockOrders();
+    time_t now = time(NULL);
+    if (now != lastReservationSweep) {
+        lastReservationSweep = now;
+        int kept = 0;
+        for (int i = 0; i < reservedOrders.count; i++) {
+            Reservation *reservation = reservationAt(reservedOrders.slots[i]);
+            if (reservation->quantity > 0 && reservation->expires <= now) {
+                __atomic_sub_fetch(productHold(reservation->product), reservation->quantity, __ATOMIC_ACQ_REL);
+                reservation->quantity = 0;
+            }
+            if (reservation->quantity > 0) {
+                reservedOrders.slots[kept++] = reservedOrders.slots[i];
+            }
+        }
+        reservedOrders.count = kept;
+    }
+    unlockOrders();
+}
+
+// Find an order by ID, returning its index or -1. Orders are stored in
+// the order their IDs were assigned, so a binary search is enough.
+int findOrder(int orderId) {
+    int low = 0, high = orderCount - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int id = orderAt(mid)->orderId;
+        if (id == orderId) return mid;
+        if (id < orderId) low = mid + 1;
+        else high = mid - 1;
+    }
+    return -1;
+}
+
+// Delete the product at index. The record stays where it is, marked as a
+// tombstone, so no other product moves. Its name is freed at once; the
+// search indexes skip it until enough tombstones build up to be worth one
+// compaction pass, which keeps deletes O(1) amortized.
+void deleteProductAt(int index) {
+    Product *product = productAt(index);
+    if (product->deleted) return;
+
+    product->deleted = 1;
+    indexRemove(&productIndex, product->name);
+    syncProductColumns(index);
+    activeProductCount--;
+    tombstoneCount++;
+    if (tombstoneCount * 8 > activeProductCount) {
+        compactSearchIndexes();
+    }
+}
+
+// Drop the entries of deleted products from a product list
+void sortedDropDeleted(SortedIndex *index) {
+    int kept = 0;
+    for (int i = 0; i < index->count; i++) {
+        if (!productAt(index->entries[i].slot)->deleted) {
+            index->entries[kept++] = index->entries[i];
+        }
+    }
+    index->count = kept;
+}
+
+// Drop the entries of deleted products from the price, category and text
+// indexes
+void compactSearchIndexes() {
+    sortedDropDeleted(&priceIndex);
+    for (int i = 0; i < categoryCount; i++) {
+        sortedDropDeleted(&categories[i].products);
+    }
+    for (int i = 0; textIndexReady && i < termCount; i++) {
+        SlotList *products = &terms[i].products;
+        int kept = 0;
+        for (int j = 0; j < products->count; j++) {
+            if (!productAt(products->slots[j] >> 2)->deleted) {
+                products->slots[kept++] = products->slots[j];
+            }
+        }
+        products->count = kept;
+    }
+    tombstoneCount = 0;
+}
+
+// Ask for the serial number of a product that has not been deleted
+int getProductSerial(const char *prompt, int min) {
+    while (1) {
+        int serial = getIntegerInput(prompt, min, productCount);
+        if (serial == 0 || !productAt(serial - 1)->deleted) {
+            return serial;
+        }
+        printf("No product with serial number %d.\n", serial);
+    }
+}
+
+// Compare two sorted index entries by key, then slot
+int compareSortedEntries(const void *a, const void *b) {
+    const SortedEntry *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->slot - y->slot;
+}
+
+// Position of the first entry not ordered before (key, slot)
+int sortedLowerBound(SortedIndex *index, float key, int slot) {
+    int low = 0, high = index->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        SortedEntry *entry = &index->entries[mid];
+        if (entry->key < key || (entry->key == key && entry->slot < slot)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Make room for one more entry
+void sortedGrow(SortedIndex *index) {
+    if (index->count < index->capacity) return;
+    // Entries without capacity still point into the snapshot mapping
+    int newCapacity = index->count ? index->count * 2 : 16;
+    SortedEntry *entries = realloc(index->capacity ? index->entries : NULL, newCapacity * sizeof(SortedEntry));
+    if (entries == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (index->capacity == 0 && index->count > 0) {
+        memcpy(entries, index->entries, index->count * sizeof(SortedEntry));
+    }
+    index->entries = entries;
+    index->capacity = newCapacity;
+}
+
+// Append without keeping order; call sortedFinish once the bulk load is done
+void sortedAppend(SortedIndex *index, float key, int slot) {
+    sortedGrow(index);
+    index->entries[index->count].key = key;
+    index->entries[index->count].slot = slot;
+    index->count++;
+}
+
+// Insert one entry at its sorted position
+void sortedInsert(SortedIndex *index, float key, int slot) {
+    sortedGrow(index);
+    int pos = sortedLowerBound(index, key, slot);
+    memmove(&index->entries[pos + 1], &index->entries[pos], (index->count - pos) * sizeof(SortedEntry));
+    index->entries[pos].key = key;
+    index->entries[pos].slot = slot;
+    index->count++;
+}
+
+// Remove the entry for (key, slot) if present
+void sortedRemove(SortedIndex *index, float key, int slot) {
+    int pos = sortedLowerBound(index, key, slot);
+    if (pos < index->count && index->entries[pos].key == key && index->entries[pos].slot == slot) {
+        memmove(&index->entries[pos], &index->entries[pos + 1], (index->count - pos - 1) * sizeof(SortedEntry));
+        index->count--;
+    }
+}
+
+// Sort entries added with sortedAppend
+void sortedFinish(SortedIndex *index) {
+    qsort(index->entries, index->count, sizeof(SortedEntry), compareSortedEntries);
+}
+
+// Key accessor for the category index
+const char *categoryKey(int slot) {
+    return categories[slot].name;
+}
+
+// Find a category by name, optionally creating it
+Category *findCategory(const char *name, int create) {
+    int slot = indexFind(&categoryIndex, name);
+    if (slot != -1) return &categories[slot];
+    if (!create) return NULL;
+
+    if (categoryCount == categoryCapacity) {
+        int newCapacity = categoryCapacity ? categoryCapacity * 2 : 16;
+        Category *grown = realloc(categories, newCapacity * sizeof(Category));
+        if (grown == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        categories = grown;
+        categoryCapacity = newCapacity;
+    }
+    Category *category = &categories[categoryCount];
+    strcpy(category->name, name);
+    category->products.entries = NULL;
+    category->products.count = 0;
+    category->products.capacity = 0;
+    category->cheapest.count = 0;
+    category->cheapest.stale = 1;
+    indexInsert(&categoryIndex, category->name, categoryCount);
+    categoryCount++;
+    return category;
+}
+
+// Slot of the named category, creating it if needed. Categories are never
+// removed, so the slot identifies the category for good.
+int categoryId(const char *name) {
+    return (int)(findCategory(name, 1) - categories);
+}
+
+// Rebuild the category and price indexes from scratch after a bulk load
+void buildSearchIndexes() {
+    priceIndex.count = 0;
+    for (int i = 0; i < categoryCount; i++) {
+        categories[i].products.count = 0;
+        categories[i].cheapest.stale = 1;
+    }
+    topRated.stale = 1;
+    bestSellers.stale = 1;
+    for (int i = 0; i < productCount; i++) {
+        Product *product = productAt(i);
+        if (product->deleted) continue;
+        sortedAppend(&priceIndex, product->price, i);
+        sortedAppend(&categories[product->category].products, product->price, i);
+    }
+    sortedFinish(&priceIndex);
+    for (int i = 0; i < categoryCount; i++) {
+        sortedFinish(&categories[i].products);
+    }
+    tombstoneCount = 0;
+    buildProductColumns();
+    if (textIndexReady) clearTextIndex();
+}
+
+// Add one product to the category and price indexes
+void indexProductForSearch(int slot) {
+    Product *product = productAt(slot);
+    sortedInsert(&priceIndex, product->price, slot);
+    sortedInsert(&categories[product->category].products, product->price, slot);
+    syncProductColumns(slot);
+    if (textIndexReady) {
+        indexText(slot, FIELD_NAME, product->name);
+        indexText(slot, FIELD_CATEGORY, categories[product->category].name);
+    }
+}
+
+// Remove one product from the category and price indexes
+void unindexProductForSearch(int slot) {
+    Product *product = productAt(slot);
+    sortedRemove(&priceIndex, product->price, slot);
+    if (product->category != -1) {
+        Category *category = &categories[product->category];
+        sortedRemove(&category->products, product->price, slot);
+        topViewRemove(&category->cheapest, slot);
+    }
+}
+
+// Make room in the product columns for count products
+void growProductColumns(int count) {
+    if (count <= productColumns.capacity) return;
+    int newCapacity = productColumns.capacity ? productColumns.capacity : 1024;
+    while (newCapacity < count) newCapacity *= 2;
+
+    // Columns without capacity still point into the snapshot mapping
+    int borrowed = productColumns.capacity == 0;
+    void **columns[] = {(void **)&productColumns.price, (void **)&productColumns.finalPrice,
+                        (void **)&productColumns.stock, (void **)&productColumns.rating,
+                        (void **)&productColumns.category};
+    for (int i = 0; i < 5; i++) {
+        void *grown = realloc(borrowed ? NULL : *columns[i], (size_t)newCapacity * 4);
+        if (grown == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (borrowed && productColumns.count > 0) {
+            memcpy(grown, *columns[i], (size_t)productColumns.count * 4);
+        }
+        *columns[i] = grown;
+    }
+    productColumns.capacity = newCapacity;
+}
+
+// Copy one product's filtered fields into the columns and refresh its top
+// lists; every change to a product passes through here
+void syncProductColumns(int slot) {
+    if (slot >= productColumns.count) {
+        growProductColumns(slot + 1);
+        productColumns.count = slot + 1;
+    }
+    Product *product = productAt(slot);
+    productColumns.price[slot] = product->price;
+    productColumns.finalPrice[slot] = product->price * (1 - product->discount / 100);
+    productColumns.stock[slot] = product->stock;
+    productColumns.rating[slot] = product->rating;
+    productColumns.category[slot] = product->deleted ? -1 : product->category;
+    updateTopViews(slot);
+}
+
+// Rebuild the product columns from the product records
+void buildProductColumns() {
+    productColumns.count = 0;
+    growProductColumns(productCount);
+    for (int i = 0; i < productCount; i++) {
+        syncProductColumns(i);
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// AVX2 version of selectFloatRange: eight products per compare
+__attribute__((target("avx2")))
+int selectFloatRangeAvx2(const float *column, int count, float low, float high, int *selection) {
+    __m256 lowVector = _mm256_set1_ps(low), highVector = _mm256_set1_ps(high);
+    int selected = 0, i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 values = _mm256_loadu_ps(column + i);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(values, lowVector, _CMP_GE_OQ),
+                                      _mm256_cmp_ps(values, highVector, _CMP_LE_OQ));
+        unsigned int mask = _mm256_movemask_ps(inside);
+        while (mask) {
+            selection[selected++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < count; i++) {
+        if (column[i] >= low && column[i] <= high) selection[selected++] = i;
+    }
+    return selected;
+}
+
+// AVX2 version of selectIntEqual
+__attribute__((target("avx2")))
+int selectIntEqualAvx2(const int *column, int count, int value, int *selection) {
+    __m256i wanted = _mm256_set1_epi32(value);
+    int selected = 0, i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i values = _mm256_loadu_si256((const __m256i *)(column + i));
+        unsigned int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(values, wanted)));
+        while (mask) {
+            selection[selected++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < count; i++) {
+        if (column[i] == value) selection[selected++] = i;
+    }
+    return selected;
+}
+
+// SSE2 version of selectFloatRange: four products per compare
+__attribute__((target("sse2")))
+int selectFloatRangeSse2(const float *column, int count, float low, float high, int *selection) {
+    __m128 lowVector = _mm_set1_ps(low), highVector = _mm_set1_ps(high);
+    int selected = 0, i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 values = _mm_loadu_ps(column + i);
+        unsigned int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(values, lowVector), _mm_cmple_ps(values, highVector)));
+        while (mask) {
+            selection[selected++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < count; i++) {
+        if (column[i] >= low && column[i] <= high) selection[selected++] = i;
+    }
+    return selected;
+}
+
+// SSE2 version of selectIntEqual
+__attribute__((target("sse2")))
+int selectIntEqualSse2(const int *column, int count, int value, int *selection) {
+    __m128i wanted = _mm_set1_epi32(value);
+    int selected = 0, i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i values = _mm_loadu_si128((const __m128i *)(column + i));
+        unsigned int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(values, wanted)));
+        while (mask) {
+            selection[selected++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < count; i++) {
+        if (column[i] == value) selection[selected++] = i;
+    }
+    return selected;
+}
+#endif
+
+// Pick the widest vector instructions this CPU supports
+int detectSimdLevel() {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return 2;
+    if (__builtin_cpu_supports("sse2")) return 1;
+#endif
+    return 0;
+}
+
+// Write to selection the positions in column[0..count) whose value lies in
+// [low, high], in order. Returns how many were selected.
+int selectFloatRange(const float *column, int count, float low, float high, int *selection) {
+    if (simdLevel < 0) simdLevel = detectSimdLevel();
+#ifdef HAVE_X86_SIMD
+    if (simdLevel == 2) return selectFloatRangeAvx2(column, count, low, high, selection);
+    if (simdLevel == 1) return selectFloatRangeSse2(column, count, low, high, selection);
+#endif
+    int selected = 0;
+    for (int i = 0; i < count; i++) {
+        selection[selected] = i;
+        selected += column[i] >= low && column[i] <= high;
+    }
+    return selected;
+}
+
+// Write to selection the positions in column[0..count) equal to value
+int selectIntEqual(const int *column, int count, int value, int *selection) {
+    if (simdLevel < 0) simdLevel = detectSimdLevel();
+#ifdef HAVE_X86_SIMD
+    if (simdLevel == 2) return selectIntEqualAvx2(column, count, value, selection);
+    if (simdLevel == 1) return selectIntEqualSse2(column, count, value, selection);
+#endif
+    int selected = 0;
+    for (int i = 0; i < count; i++) {
+        selection[selected] = i;
+        selected += column[i] == value;
+    }
+    return selected;
+}
+
+// Scan the product columns for products matching filter. The first
+// predicate (category if given, else price) is evaluated with vector
+// compares into a selection vector of one block of products; the others
+// only look at the products still selected. Results are product slots in
+// serial order; the caller frees them.
+int filterProducts(const ProductFilter *filter, int **results) {
+    STAT_START();
+    int selection[FILTER_BLOCK];
+    int count = 0, capacity = 0;
+    const float *prices = filter->byFinalPrice ? productColumns.finalPrice : productColumns.price;
+    *results = NULL;
+
+    for (int start = 0; start < productColumns.count; start += FILTER_BLOCK) {
+        int length = productColumns.count - start < FILTER_BLOCK ? productColumns.count - start : FILTER_BLOCK;
+        int selected;
+        if (filter->category >= 0) {
+            selected = selectIntEqual(productColumns.category + start, length, filter->category, selection);
+        } else {
+            selected = selectFloatRange(prices + start, length, filter->minPrice, filter->maxPrice, selection);
+        }
+
+        int kept = 0;
+        for (int i = 0; i < selected; i++) {
+            int slot = start + selection[i];
+            if (productColumns.category[slot] < 0 ||
+                prices[slot] < filter->minPrice || prices[slot] > filter->maxPrice ||
+                productColumns.rating[slot] < filter->minRating ||
+                (filter->inStockOnly && productColumns.stock[slot] <= 0)) continue;
+            selection[kept++] = slot;
+        }
+        if (kept == 0) continue;
+
+        if (count + kept > capacity) {
+            capacity = (count + kept) * 2;
+            int *grown = realloc(*results, capacity * sizeof(int));
+            if (grown == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            *results = grown;
+        }
+        memcpy(*results + count, selection, kept * sizeof(int));
+        count += kept;
+    }
+    STAT_RECORD(STAT_FILTER, 0);
+    return count;
+}
+
+// Compare two slots for qsort
+int compareSlots(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Collect the products in a category (NULL for any) and, if byPrice, within
+// [minPrice, maxPrice]. Results are product slots in serial order; the
+// caller frees them. Runs in O(log n + k) using the secondary indexes.
+int findMatchingProducts(const char *category, int byPrice, float minPrice, float maxPrice, int **results) {
+    STAT_START();
+    SortedIndex *index = &priceIndex;
+    *results = NULL;
+    if (category != NULL) {
+        Category *match = findCategory(category, 0);
+        if (match == NULL) {
+            STAT_RECORD(STAT_SEARCH, 0);
+            return 0;
+        }
+        index = &match->products;
+    }
+
+    int start = 0, end = index->count;
+    if (byPrice) {
+        start = sortedLowerBound(index, minPrice, -1);
+        end = start;
+        while (end < index->count && index->entries[end].key <= maxPrice) {
+            end++;
+        }
+    }
+    if (end == start) {
+        STAT_RECORD(STAT_SEARCH, 0);
+        return 0;
+    }
+
+    *results = malloc((end - start) * sizeof(int));
+    if (*results == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    int count = 0;
+    for (int i = start; i < end; i++) {
+        if (!productAt(index->entries[i].slot)->deleted) {
+            (*results)[count++] = index->entries[i].slot;
+        }
+    }
+    qsort(*results, count, sizeof(int), compareSlots);
+    STAT_RECORD(STAT_SEARCH, 0);
+    return count;
+}
+
+// Same as findMatchingProducts but by scanning every product; kept as the
+// baseline for the search benchmark
+int scanMatchingProducts(const char *category, int byPrice, float minPrice, float maxPrice, int **results) {
+    int count = 0, capacity = 0;
+    *results = NULL;
+    Category *match = category != NULL ? findCategory(category, 0) : NULL;
+    if (category != NULL && match == NULL) return 0;
+    for (int i = 0; i < productCount; i++) {
+        Product *product = productAt(i);
+        if (product->deleted) continue;
+        if (match != NULL && product->category != (int)(match - categories)) continue;
+        if (byPrice && (product->price < minPrice || product->price > maxPrice)) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            int *grown = realloc(*results, capacity * sizeof(int));
+            if (grown == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            *results = grown;
+        }
+        (*results)[count++] = i;
+    }
+    return count;
+}
+
+// Read the next word of text at *cursor and advance past it. A word is a
+// run of letters or a run of digits, lowercased and cut to fit TERM_LENGTH.
+// Returns its length, or 0 once the text is used up.
+int nextWord(const char **cursor, char *word) {
+    const char *p = *cursor;
+    while (*p != '\0' && !isalnum((unsigned char)*p)) p++;
+    int digits = isdigit((unsigned char)*p) != 0;
+    int length = 0;
+    while (*p != '\0' && isalnum((unsigned char)*p) && (isdigit((unsigned char)*p) != 0) == digits) {
+        if (length < TERM_LENGTH - 1) word[length++] = (char)tolower((unsigned char)*p);
+        p++;
+    }
+    word[length] = '\0';
+    *cursor = p;
+    return length;
+}
+
+// Key accessor for the term index
+const char *termKey(int slot) {
+    return terms[slot].text;
+}
+
+// qsort comparator ordering term slots by their text
+int compareTerms(const void *a, const void *b) {
+    return strcmp(terms[*(const int *)a].text, terms[*(const int *)b].text);
+}
+
+// First position in termOrder whose word sorts at or after word
+int termLowerBound(const char *word) {
+    int low = 0, high = termCount;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (strcmp(terms[termOrder[mid]].text, word) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Add a (hash, term) pair to the typo index. Unlike indexInsert, pairs
+// with the same hash are all kept: the index maps each deletion to every
+// word it comes from, and lookups check each word against the query.
+void typoInsert(unsigned int hash, int term) {
+    if ((typoIndex.count + 1) * 2 > typoIndex.capacity) {
+        indexResize(&typoIndex, typoIndex.capacity ? typoIndex.capacity * 2 : 1024);
+    }
+    int mask = typoIndex.capacity - 1;
+    int i = hash & mask;
+    while (typoIndex.entries[i].slot != -1) {
+        i = (i + 1) & mask;
+    }
+    typoIndex.entries[i].hash = hash;
+    typoIndex.entries[i].slot = term;
+    typoIndex.count++;
+}
+
+// Find the term of a word, adding it if the word is new. While the index is
+// being built new terms go to the end of termOrder, which buildTextIndex
+// sorts once; after that each is inserted in place.
+int findTerm(const char *word) {
+    int term = indexFind(&termIndex, word);
+    if (term != -1) return term;
+
+    if (termCount == termCapacity) {
+        int newCapacity = termCapacity ? termCapacity * 2 : 1024;
+        Term *grownTerms = realloc(terms, newCapacity * sizeof(Term));
+        int *grownOrder = realloc(termOrder, newCapacity * sizeof(int));
+        if (grownTerms == NULL || grownOrder == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        terms = grownTerms;
+        termOrder = grownOrder;
+        termCapacity = newCapacity;
+    }
+    term = termCount;
+    strcpy(terms[term].text, word);
+    terms[term].products.slots = NULL;
+    terms[term].products.count = 0;
+    terms[term].products.capacity = 0;
+    indexInsert(&termIndex, terms[term].text, term);
+
+    int position = textIndexReady ? termLowerBound(word) : termCount;
+    memmove(termOrder + position + 1, termOrder + position, (termCount - position) * sizeof(int));
+    termOrder[position] = term;
+    termCount++;
+
+    // Words are all letters or all digits; only words get typo matches
+    int length = strlen(word);
+    if (length >= TYPO_MIN_LENGTH && isalpha((unsigned char)word[0])) {
+        char deletion[TERM_LENGTH];
+        for (int i = 0; i < length; i++) {
+            memcpy(deletion, word, i);
+            strcpy(deletion + i, word + i + 1);
+            typoInsert(hashString(deletion), term);
+        }
+    }
+    return term;
+}
+
+// First position in a posting list holding posting or a later one
+int postingLowerBound(const SlotList *products, int posting) {
+    int low = 0, high = products->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (products->slots[mid] < posting) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Add a posting to a term's list in order. New products and the fields of
+// one product arrive in order and are appended; only a review of an older
+// product has to be moved into place.
+void insertPosting(SlotList *products, int posting) {
+    if (products->count == 0 || products->slots[products->count - 1] < posting) {
+        slotListAppend(products, posting);
+        return;
+    }
+    int position = postingLowerBound(products, posting);
+    if (products->slots[position] == posting) return;
+    slotListAppend(products, posting);
+    memmove(products->slots + position + 1, products->slots + position,
+            (products->count - 1 - position) * sizeof(int));
+    products->slots[position] = posting;
+}
+
+// Add the words of one text field of the product in slot to the text index
+void indexText(int slot, int field, const char *text) {
+    char word[TERM_LENGTH];
+    while (nextWord(&text, word) > 0) {
+        int term = findTerm(word); // May move terms
+        insertPosting(&terms[term].products, slot * 4 + field);
+    }
+}
+
+// Empty the text index; the next text search builds it again
+void clearTextIndex() {
+    for (int i = 0; i < termCount; i++) {
+        free(terms[i].products.slots);
+    }
+    termCount = 0;
+    free(termIndex.entries);
+    termIndex.entries = NULL;
+    termIndex.capacity = termIndex.count = 0;
+    free(typoIndex.entries);
+    typoIndex.entries = NULL;
+    typoIndex.capacity = typoIndex.count = 0;
+    textIndexReady = 0;
+}
+
+// Build the text index from every live product and its reviews. Fields
+// are indexed in posting order, so every posting is appended.
+void buildTextIndex() {
+    clearTextIndex();
+    for (int i = 0; i < productCount; i++) {
+        Product *product = productAt(i);
+        if (product->deleted) continue;
+        for (int review = product->latestReview; review != -1; review = reviewAt(review)->previous) {
+            indexText(i, FIELD_REVIEW, reviewAt(review)->text);
+        }
+        indexText(i, FIELD_CATEGORY, categories[product->category].name);
+        indexText(i, FIELD_NAME, product->name);
+    }
+    qsort(termOrder, termCount, sizeof(int), compareTerms);
+    textIndexReady = 1;
+}
+
+// Whether a and b are at most one inserted, deleted or replaced letter, or
+// one swap of neighbouring letters, apart
+int withinOneEdit(const char *a, int aLength, const char *b, int bLength) {
+    if (aLength > bLength) {
+        const char *swap = a;
+        a = b;
+        b = swap;
+        int swapLength = aLength;
+        aLength = bLength;
+        bLength = swapLength;
+    }
+    if (bLength - aLength > 1) return 0;
+
+    int i = 0;
+    while (i < aLength && a[i] == b[i]) i++;
+    if (i == aLength) return 1;
+    if (aLength < bLength) return strcmp(a + i, b + i + 1) == 0;
+    if (strcmp(a + i + 1, b + i + 1) == 0) return 1;
+    return i + 1 < aLength && a[i] == b[i + 1] && a[i + 1] == b[i] && strcmp(a + i + 2, b + i + 2) == 0;
+}
+
+// Add term to a query word's typo matches if it really is one typo away
+void addTypoTerm(QueryWord *word, int term) {
+    if (term == -1 || word->typoTermCount == TYPO_TERMS_MAX) return;
+    for (int i = 0; i < word->typoTermCount; i++) {
+        if (word->typoTerms[i] == term) return;
+    }
+    if (!withinOneEdit(word->text, word->length, terms[term].text, strlen(terms[term].text))) return;
+    word->typoTerms[word->typoTermCount++] = term;
+    word->postings += terms[term].products.count;
+}
+
+// Collect the indexed words one typo away from a query word. A word with
+// a letter too many is found by deleting each letter of the query and
+// looking it up; one with a letter too few, a different letter or two
+// letters swapped shares a deletion with the query in the typo index.
+void findTypoTerms(QueryWord *word) {
+    char deletion[TERM_LENGTH];
+    word->typoTermCount = 0;
+    if (word->length < TYPO_MIN_LENGTH || !isalpha((unsigned char)word->text[0])) return;
+
+    // i == -1 stands for the query word itself
+    for (int i = -1; i < word->length; i++) {
+        if (i == -1) {
+            strcpy(deletion, word->text);
+        } else {
+            memcpy(deletion, word->text, i);
+            strcpy(deletion + i, word->text + i + 1);
+            addTypoTerm(word, indexFind(&termIndex, deletion));
+        }
+        if (typoIndex.count == 0) continue;
+        unsigned int hash = hashString(deletion);
+        int mask = typoIndex.capacity - 1;
+        for (int j = hash & mask; typoIndex.entries[j].slot != -1; j = (j + 1) & mask) {
+            if (typoIndex.entries[j].hash == hash) addTypoTerm(word, typoIndex.entries[j].slot);
+        }
+    }
+}
+
+// How well a query word matches a text field: 3 if one of its words equals
+// the query word, 2 if one begins with it and 1 if one is a typo away
+int matchField(const QueryWord *word, const char *text) {
+    char candidate[TERM_LENGTH];
+    int best = 0, length;
+    while ((length = nextWord(&text, candidate)) > 0) {
+        if (word->typo) {
+            if (withinOneEdit(word->text, word->length, candidate, length)) return 1;
+        } else if (length >= word->length && memcmp(candidate, word->text, word->length) == 0) {
+            if (length == word->length) return 3;
+            best = 2;
+        }
+    }
+    return best;
+}
+
+// Best relevance of a query word for the product in slot, found by binary
+// searching the postings of each word it matches
+int postingRelevance(const QueryWord *word, int slot) {
+    int best = 0;
+    int matched = word->typo ? word->typoTermCount : word->last - word->first;
+    for (int i = 0; i < matched; i++) {
+        Term *term = &terms[word->typo ? word->typoTerms[i] : termOrder[word->first + i]];
+        int match = word->typo ? 1 : term->text[word->length] == '\0' ? 3 : 2;
+        for (int j = postingLowerBound(&term->products, slot * 4);
+             j < term->products.count && term->products.slots[j] >> 2 == slot; j++) {
+            int relevance = match * ((term->products.slots[j] & 3) + 1);
+            if (relevance > best) best = relevance;
+        }
+    }
+    return best;
+}
+
+// Relevance of the product in slot to the query words other than skip:
+// the sum of each word's best match, counted three times in the name,
+// twice in the category and once in a review. 0 if some word does not
+// match at all.
+int scoreProduct(int slot, QueryWord *words, int wordCount, int skip) {
+    Product *product = productAt(slot);
+    int total = 0;
+    for (int i = 0; i < wordCount; i++) {
+        if (i == skip) continue;
+        int matched = words[i].typo ? words[i].typoTermCount : words[i].last - words[i].first;
+        int best;
+        if (matched <= PROBE_TERMS_MAX) {
+            best = postingRelevance(&words[i], slot);
+        } else {
+            // A short prefix begins too many words to look each one up
+            best = matchField(&words[i], product->name) * 3;
+            if (best < 6) {
+                int category = matchField(&words[i], categories[product->category].name) * 2;
+                if (category > best) best = category;
+            }
+            for (int review = product->latestReview; review != -1 && best < 3; review = reviewAt(review)->previous) {
+                int match = matchField(&words[i], reviewAt(review)->text);
+                if (match > best) best = match;
+            }
+        }
+        if (best == 0) return 0;
+        total += best;
+    }
+    return total;
+}
+
+// Fill results with up to limit live products whose name, category or
+// reviews match every word of query, best first and then by serial. A product's score is its
+// relevance raised by up to half again for a 5.00 rating; the relevance of
+// each word is its match (see matchField) times the weight of its field.
+// Only the postings of the query word listed under the fewest products
+// are read, so a query costs about as much as its rarest word, and
+// postings that cannot beat the last result are skipped unseen.
+int searchText(const char *query, int limit, int *results) {
+    STAT_START();
+    QueryWord words[QUERY_WORDS];
+    float scores[TEXT_RESULTS_MAX];
+    int wordCount = 0, rarest = 0;
+    if (!textIndexReady) buildTextIndex();
+    if (limit > TEXT_RESULTS_MAX) limit = TEXT_RESULTS_MAX;
+
+    while (wordCount < QUERY_WORDS) {
+        QueryWord *word = &words[wordCount];
+        word->length = nextWord(&query, word->text);
+        if (word->length == 0) break;
+
+        word->first = termLowerBound(word->text);
+        word->last = word->first;
+        word->postings = 0;
+        while (word->last < termCount &&
+               strncmp(terms[termOrder[word->last]].text, word->text, word->length) == 0) {
+            word->postings += terms[termOrder[word->last]].products.count;
+            word->last++;
+        }
+        // Words left without products by compactSearchIndexes count as absent
+        word->typo = word->postings == 0;
+        word->typoTermCount = 0;
+        if (word->typo) findTypoTerms(word);
+        if (word->postings == 0) {
+            STAT_RECORD(STAT_TEXT_SEARCH, 0);
+            return 0;
+        }
+        if (word->postings < words[rarest].postings) rarest = wordCount;
+        wordCount++;
+    }
+
+    QueryWord *driver = &words[rarest];
+    int matched = wordCount == 0 || limit < 1 ? 0 : driver->typo ? driver->typoTermCount : driver->last - driver->first;
+    int count = 0;
+    for (int i = 0; i < matched; i++) {
+        Term *term = &terms[driver->typo ? driver->typoTerms[i] : termOrder[driver->first + i]];
+        int match = driver->typo ? 1 : term->text[driver->length] == '\0' ? 3 : 2;
+        for (int j = 0; j < term->products.count; j++) {
+            int slot = term->products.slots[j] >> 2;
+            int relevance = match * ((term->products.slots[j] & 3) + 1);
+            // Every other word adds at most 9 and the rating half again
+            if (count == limit && (relevance + 9 * (wordCount - 1)) * 1.5f < scores[count - 1]) continue;
+            if (productColumns.category[slot] == -1) continue; // Deleted
+            if (wordCount > 1) {
+                int rest = scoreProduct(slot, words, wordCount, rarest);
+                if (rest == 0) continue;
+                relevance += rest;
+            }
+            float score = relevance * (1.0f + productColumns.rating[slot] / 10.0f);
+
+            // Rank the product, keeping only its best score if it is
+            // already listed through another field or matching word.
+            // Equal scores go in serial order.
+            int k = 0;
+            while (k < count && results[k] != slot) k++;
+            if (k < count) {
+                if (score <= scores[k]) continue;
+            } else if (count < limit) {
+                k = count++;
+            } else if (score > scores[count - 1] || (score == scores[count - 1] && slot < results[count - 1])) {
+                k = count - 1;
+            } else {
+                continue;
+            }
+            while (k > 0 && (scores[k - 1] < score || (scores[k - 1] == score && results[k - 1] > slot))) {
+                scores[k] = scores[k - 1];
+                results[k] = results[k - 1];
+                k--;
+            }
+            scores[k] = score;
+            results[k] = slot;
+        }
+    }
+    STAT_RECORD(STAT_TEXT_SEARCH, 0);
+    return count;
+}
+
+// Units of the product in slot sold in paid orders, once countSales has run
+int *productSales(int slot) {
+    while (salesCount <= slot) {
+        *(int *)poolReserve(&salesPool, salesCount++) = 0;
+    }
+    return (int *)(salesPool.chunks[slot >> POOL_CHUNK_SHIFT] + (size_t)(slot & (POOL_CHUNK_SIZE - 1)) * sizeof(int));
+}
+
+// Count the units of each product in paid orders. Checkouts keep the
+// counts current from then on.
+void countSales() {
+    for (int i = 0; i < productCount; i++) {
+        *productSales(i) = 0;
+    }
+    for (int i = 0; i < orderCount; i++) {
+        Order *order = orderAt(i);
+        if (order->status == ORDER_PAID) *productSales(order->product) += order->quantity;
+    }
+    salesCounted = 1;
+}
+
+// Sort key of the product in slot in a kind of top list, lowest first.
+// Returns 0 if the product does not belong in that list. Reads the product
+// columns, so a rebuild scans 4 bytes a product rather than whole rows.
+int topViewKey(int kind, int slot, float *key) {
+    if (productColumns.category[slot] == -1) return 0; // Deleted
+    if (kind == TOP_RATED) {
+        *key = -productColumns.rating[slot];
+    } else if (kind == TOP_CHEAPEST) {
+        *key = productColumns.finalPrice[slot];
+    } else {
+        if (!salesCounted || *productSales(slot) == 0) return 0;
+        *key = -(float)*productSales(slot);
+    }
+    return 1;
+}
+
+// Put an entry in its place in a top list, dropping the last entry if the
+// list is full. An entry that would go after the last one of an incomplete
+// list is left out, since better products may be missing before it.
+void topViewInsert(TopView *view, float key, int slot) {
+    SortedEntry entry = {key, slot};
+    int count = view->count;
+    if (count > 0 && compareSortedEntries(&entry, &view->entries[count - 1]) > 0) {
+        if (!view->complete) return;
+        if (count == TOP_VIEW_CAPACITY) {
+            view->complete = 0;
+            return;
+        }
+    }
+    if (count == TOP_VIEW_CAPACITY) {
+        count--;
+        view->complete = 0;
+    }
+    int i = count;
+    while (i > 0 && compareSortedEntries(&entry, &view->entries[i - 1]) < 0) {
+        view->entries[i] = view->entries[i - 1];
+        i--;
+    }
+    view->entries[i] = entry;
+    view->count = count + 1;
+}
+
+// Drop the product in slot from a top list. A list that no longer fills a
+// page and may be missing products is marked for rebuilding.
+void topViewRemove(TopView *view, int slot) {
+    for (int i = 0; i < view->count; i++) {
+        if (view->entries[i].slot == slot) {
+            memmove(view->entries + i, view->entries + i + 1, (view->count - i - 1) * sizeof(SortedEntry));
+            view->count--;
+            break;
+        }
+    }
+    if (!view->complete && view->count < TOP_VIEW_SIZE) view->stale = 1;
+}
+
+// Move the product in slot to its place for a new key, or out of the list
+void topViewUpdate(TopView *view, int slot, int eligible, float key) {
+    if (view->stale) return;
+    topViewRemove(view, slot);
+    if (eligible && !view->stale) topViewInsert(view, key, slot);
+}
+
+// Refresh the product in slot in every top list it belongs to
+void updateTopViews(int slot) {
+    float key = 0;
+    int eligible = topViewKey(TOP_RATED, slot, &key);
+    topViewUpdate(&topRated, slot, eligible, key);
+    eligible = topViewKey(TOP_SELLERS, slot, &key);
+    topViewUpdate(&bestSellers, slot, eligible, key);
+    int category = productAt(slot)->category;
+    if (category != -1) {
+        eligible = topViewKey(TOP_CHEAPEST, slot, &key);
+        topViewUpdate(&categories[category].cheapest, slot, eligible, key);
+    }
+}
+
+// Fill a top list from scratch: from the products of one category, or
+// from every product if category is NULL
+void rebuildTopView(TopView *view, int kind, Category *category) {
+    float key;
+    view->count = 0;
+    view->complete = 1;
+    view->stale = 0;
+    if (kind == TOP_SELLERS && !salesCounted) countSales();
+    int count = category != NULL ? category->products.count : productCount;
+    for (int i = 0; i < count; i++) {
+        int slot = category != NULL ? category->products.entries[i].slot : i;
+        if (topViewKey(kind, slot, &key)) topViewInsert(view, key, slot);
+    }
+}
+
+// Fill results with the first k products of a top list: the best rated,
+// the best selling, or the cheapest after discount in a category. Costs
+// O(k) unless too many products have left the list since it was filled.
+int topProducts(int kind, const char *category, int k, int *results) {
+    TopView *view = kind == TOP_RATED ? &topRated : &bestSellers;
+    Category *match = NULL;
+    if (kind == TOP_CHEAPEST) {
+        match = findCategory(category, 0);
+        if (match == NULL) return 0;
+        view = &match->cheapest;
+    }
+    if (view->stale) rebuildTopView(view, kind, match);
+    if (k > view->count) k = view->count;
+    for (int i = 0; i < k; i++) {
+        results[i] = view->entries[i].slot;
+    }
+    return k;
+}
+
+// Append a slot to a list
+void slotListAppend(SlotList *list, int slot) {
+    // A list with slots but no capacity still points into the snapshot
+    // mapping, so it has to be copied out before it can grow
+    if (list->count >= list->capacity) {
+        int newCapacity = list->count ? list->count * 2 : 8;
+        int *slots = realloc(list->capacity ? list->slots : NULL, newCapacity * sizeof(int));
+        if (slots == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (list->capacity == 0 && list->count > 0) {
+            memcpy(slots, list->slots, list->count * sizeof(int));
+        }
+        list->slots = slots;
+        list->capacity = newCapacity;
+    }
+    list->slots[list->count++] = slot;
+}
+
+// Key accessor for the per-user order index
+const char *customerKey(int slot) {
+    return customers[slot].username;
+}
+
+// Find a user's order lists, optionally creating empty ones
+CustomerOrders *findCustomerOrders(const char *username, int create) {
+    int slot = indexFind(&customerIndex, username);
+    if (slot != -1) return &customers[slot];
+    if (!create) return NULL;
+
+    if (customerCount == customerCapacity) {
+        int newCapacity = customerCapacity ? customerCapacity * 2 : 16;
+        CustomerOrders *grown = realloc(customers, newCapacity * sizeof(CustomerOrders));
+        if (grown == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        customers = grown;
+        customerCapacity = newCapacity;
+    }
+    CustomerOrders *customer = &customers[customerCount];
+    memset(customer, 0, sizeof(CustomerOrders));
+    strcpy(customer->username, username);
+    indexInsert(&customerIndex, customer->username, customerCount);
+    customerCount++;
+    return customer;
+}
+
+// Text of a dictionary entry, or "" for -1
+const char *stringAt(int id) {
+    if (id < 0) return "";
+    return ((DictionaryString *)(dictionaryPool.chunks[id >> POOL_CHUNK_SHIFT] +
+                                 (size_t)(id & (POOL_CHUNK_SIZE - 1)) * sizeof(DictionaryString)))->text;
+}
+
+// Dictionary entry holding text, added on first use. Text longer than an
+// entry is cut to fit before the lookup, so it finds what was stored.
+int internString(const char *text) {
+    DictionaryString key;
+    snprintf(key.text, sizeof(key.text), "%s", text);
+    int id = indexFind(&dictionaryIndex, key.text);
+    if (id != -1) return id;
+    DictionaryString *entry = poolReserve(&dictionaryPool, dictionaryCount);
+    *entry = key;
+    indexInsert(&dictionaryIndex, entry->text, dictionaryCount);
+    return dictionaryCount++;
+}
+
+// Product slot for an order of the named product. The text files and the
+// change log name products, and an order may outlive its product there, so
+// a product no longer sold gets a deleted record for its orders to use.
+int orderProductSlot(const char *name) {
+    int slot = findProduct(name);
+    if (slot == -1) slot = indexFind(&retiredProductIndex, name);
+    if (slot != -1) return slot;
+
+    Product *product = poolReserve(&productPool, productCount);
+    memset(product, 0, sizeof(Product));
+    snprintf(product->name, sizeof(product->name), "%s", name);
+    product->category = -1;
+    product->latestReview = -1;
+    product->deleted = 1;
+    slot = productCount++;
+    syncProductColumns(slot);
+    indexInsert(&retiredProductIndex, product->name, slot);
+    coverReservations();
+    return slot;
+}
+
+// Turn a line of orders.txt into an order, looking up what it names
+void orderFromLine(OrderLine *line, Order *order) {
+    order->orderId = line->orderId;
+    order->customer = (int)(findCustomerOrders(line->username, 1) - customers);
+    order->product = orderProductSlot(line->productName);
+    order->quantity = line->quantity;
+    order->totalPrice = line->totalPrice;
+    const char *address = line->address;
+    const char *method = line->paymentMethod;
+    // "Cash on Delivery" is written with its spaces, so it reads back as
+    // the method "Cash" and an address starting "on Delivery"
+    if (strcmp(method, "Cash") == 0 && strncmp(address, "on Delivery", 11) == 0 &&
+        (address[11] == '\0' || address[11] == ' ')) {
+        method = "Cash on Delivery";
+        address += address[11] == ' ' ? 12 : 11;
+    }
+    order->address = internString(address);
+    if (strcmp(method, "Pending") == 0 || strcmp(method, "Cancelled") == 0) {
+        order->status = method[0] == 'P' ? ORDER_PENDING : ORDER_CANCELLED;
+        order->paymentMethod = -1;
+    } else {
+        order->status = ORDER_PAID;
+        order->paymentMethod = internString(method);
+    }
+}
+
+// Payment method of an order as shown and saved
+const char *orderMethod(Order *order) {
+    if (order->status == ORDER_CANCELLED) return "Cancelled";
+    return order->status == ORDER_PAID ? stringAt(order->paymentMethod) : "Pending";
+}
+
+// Add the order at slot to its user's lists
+void indexOrder(int slot) {
+    Order *order = orderAt(slot);
+    CustomerOrders *customer = &customers[order->customer];
+    slotListAppend(&customer->orders, slot);
+    if (order->status == ORDER_PENDING) {
+        slotListAppend(&customer->pending, slot);
+    }
+}
+
+// Take the order at slot off its user's pending list
+void dropPending(CustomerOrders *customer, int slot) {
+    for (int j = 0; j < customer->pending.count; j++) {
+        if (customer->pending.slots[j] == slot) {
+            customer->pending.slots[j] = customer->pending.slots[--customer->pending.count];
+            break;
+        }
+    }
+}
+
+// Cancel the cart items of products that are no longer sold, so they do
+// not hold up checkout of the rest. Returns how many were dropped.
+int dropStaleCartItems(CustomerOrders *customer, int report) {
+    int dropped = 0;
+    for (int i = customer->pending.count - 1; i >= 0; i--) {
+        int slot = customer->pending.slots[i];
+        Order *order = orderAt(slot);
+        if (isLiveProduct(order->product)) continue;
+        if (report) printf("%s is no longer available and was removed from your cart.\n", productAt(order->product)->name);
+        Reservation *reservation = reservationAt(slot);
+        if (reservation->quantity > 0) {
+            __atomic_sub_fetch(productHold(reservation->product), reservation->quantity, __ATOMIC_ACQ_REL);
+            reservation->quantity = 0;
+        }
+        order->status = ORDER_CANCELLED;
+        customer->pending.slots[i] = customer->pending.slots[--customer->pending.count];
+        logChange("cancel %d\n", order->orderId);
+        dropped++;
+    }
+    return dropped;
+}
+
+// Compare cart lines by product slot
+int compareCartLines(const void *a, const void *b) {
+    return ((const CartLine *)a)->slot - ((const CartLine *)b)->slot;
+}
+
+// Total a user's pending items per product and check that every product
+// still exists and has the stock. Returns the number of lines (caller
+// frees them), or -1 if the cart cannot be filled.
+int collectCartLines(CustomerOrders *customer, CartLine **lines, int report) {
+    int count = 0;
+    *lines = malloc((customer->pending.count > 0 ? customer->pending.count : 1) * sizeof(CartLine));
+    if (*lines == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < customer->pending.count; i++) {
+        Order *order = orderAt(customer->pending.slots[i]);
+        int slot = order->product;
+        if (!isLiveProduct(slot)) {
+            if (report) printf("%s is no longer available.\n", productAt(slot)->name);
+            free(*lines);
+            *lines = NULL;
+            return -1;
+        }
+        Reservation *reservation = reservationAt(customer->pending.slots[i]);
+        (*lines)[count].slot = slot;
+        (*lines)[count].quantity = order->quantity;
+        (*lines)[count].held = reservation->product == slot ? reservation->quantity : 0;
+        count++;
+    }
+
+    // Merge lines for the same product so each stock check sees the total
+    qsort(*lines, count, sizeof(CartLine), compareCartLines);
+    int merged = 0;
+    for (int i = 0; i < count; i++) {
+        if (merged > 0 && (*lines)[merged - 1].slot == (*lines)[i].slot) {
+            (*lines)[merged - 1].quantity += (*lines)[i].quantity;
+            (*lines)[merged - 1].held += (*lines)[i].held;
+        } else {
+            (*lines)[merged++] = (*lines)[i];
+        }
+    }
+    for (int i = 0; i < merged; i++) {
+        // Reserved items are already covered; the rest needs free stock
+        Product *product = productAt((*lines)[i].slot);
+        int available = availableStock((*lines)[i].slot);
+        if (available < (*lines)[i].quantity - (*lines)[i].held) {
+            if (report) printf("Only %d of %s left in stock.\n", available + (*lines)[i].held, product->name);
+            free(*lines);
+            *lines = NULL;
+            return -1;
+        }
+    }
+    return merged;
+}
+
+// Check out a user's whole cart as one transaction: take the stock for
+// every item, mark the orders paid and log it all in one write. If any
+// item cannot be filled nothing is changed and 0 is returned.
+int commitCheckout(CustomerOrders *customer, const char *paymentMethod) {
+    CartLine *lines;
+    int count = collectCartLines(customer, &lines, 0);
+    if (count < 0) return 0;
+
+    int method = internString(paymentMethod);
+    beginChangeBatch();
+    for (int i = 0; i < customer->pending.count; i++) {
+        Order *order = orderAt(customer->pending.slots[i]);
+        order->status = ORDER_PAID;
+        order->paymentMethod = method;
+        reservationAt(customer->pending.slots[i])->quantity = 0;
+        logChange("paid %d %s\n", order->orderId, stringAt(method));
+    }
+    customer->pending.count = 0;
+
+    for (int i = 0; i < count; i++) {
+        // Turn the cart's reservations into a stock decrement
+        Product *product = productAt(lines[i].slot);
+        product->stock -= lines[i].quantity;
+        if (salesCounted) *productSales(lines[i].slot) += lines[i].quantity;
+        syncProductColumns(lines[i].slot);
+        __atomic_sub_fetch(productHold(lines[i].slot), lines[i].held, __ATOMIC_ACQ_REL);
+        if (product->stock <= 0) {
+            // Auto delete out-of-stock products
+            logChange("remove %s\n", product->name);
+            deleteProductAt(lines[i].slot);
+        } else {
+            logChange("stock %s %d\n", product->name, product->stock);
+        }
+    }
+    endChangeBatch();
+    free(lines);
+    return 1;
+}
+
+// Whitespace as scanf skips it: space, \t, \n, \v, \f and \r, tested as
+// one bit mask lookup since this runs for every byte loaded
+int isScanSpace(char c) {
+    return (unsigned char)c <= ' ' && ((1ULL << (unsigned char)c) & 0x100003E00ULL) != 0;
+}
+
+// Skip whitespace up to the end of the line
+const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && *p != '\n' && isScanSpace(*p)) p++;
+    return p;
+}
+
+// Read a word of 1..width characters like %<width>s. Returns 0 if the
+// field is empty or longer, which scanf would split across two fields.
+int scanWord(const char **cursor, const char *end, char *out, int width) {
+    const char *start = skipBlanks(*cursor, end);
+    const char *p = start;
+    while (p < end && !isScanSpace(*p)) p++;
+    if (p == start || p - start > width) return 0;
+    memcpy(out, start, p - start);
+    out[p - start] = '\0';
+    *cursor = p;
+    return 1;
+}
+
+// Read an integer like %d. Only plain decimals of up to nine digits
+// followed by whitespace are accepted.
+int scanInt(const char **cursor, const char *end, int *value) {
+    const char *p = skipBlanks(*cursor, end);
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char *digits = p;
+    int result = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - digits < 9) result = result * 10 + (*p++ - '0');
+    if (p == digits || (p < end && !isScanSpace(*p))) return 0;
+    *value = negative ? -result : result;
+    *cursor = p;
+    return 1;
+}
+
+// Read a float like %f. Plain decimals ("12", "12.50", ".5") followed by
+// whitespace are accepted. When the digits fit in a float's mantissa and
+// there are at most ten decimals, both the digits and the power of ten are
+// exact floats, so one division gives the correctly rounded value, the
+// same as strtof; anything longer goes through strtof itself.
+int scanFloat(const char **cursor, const char *end, float *value) {
+    static const float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const char *start = skipBlanks(*cursor, end);
+    const char *p = start;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0, decimals = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits++ < 19) mantissa = mantissa * 10 + (*p - '0');
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits++ < 19) mantissa = mantissa * 10 + (*p - '0');
+            decimals++;
+            p++;
+        }
+    }
+    if (digits == 0 || (p < end && !isScanSpace(*p))) return 0;
+    if (FLT_EVAL_METHOD == 0 && digits <= 19 && mantissa <= (1u << 24) && decimals <= 10) {
+        float result = (float)mantissa / powers[decimals];
+        *value = negative ? -result : result;
+    } else {
+        char text[64];
+        if (p - start >= (long)sizeof(text)) return 0;
+        memcpy(text, start, p - start);
+        text[p - start] = '\0';
+        *value = strtof(text, NULL);
+    }
+    *cursor = p;
+    return 1;
+}
+
+// Read the rest of the line like " %<width>[^\n]". Returns 0 if the text
+// is empty or longer than width.
+int scanText(const char **cursor, const char *end, char *out, int width) {
+    const char *start = skipBlanks(*cursor, end);
+    const char *p = memchr(start, '\n', end - start);
+    if (p == NULL) p = end;
+    if (p == start || p - start > width) return 0;
+    memcpy(out, start, p - start);
+    out[p - start] = '\0';
+    *cursor = p;
+    return 1;
+}
+
+// Record parsers for the text data files. Each parses one record that
+// lies within a single line, or returns 0 and leaves the line to fscanf.
+int scanUser(const char **cursor, const char *end, void *record) {
+    User *user = record;
+    return scanWord(cursor, end, user->username, 49) &&
+           scanWord(cursor, end, user->password, 49) &&
+           scanInt(cursor, end, &user->isAdmin);
+}
+
+// The last products.txt field is the product's latest review, kept for
+// people reading the file; the reviews themselves are in reviews.txt
+int scanProduct(const char **cursor, const char *end, void *record) {
+    ProductLine *product = record;
+    char latestReview[100];
+    return scanWord(cursor, end, product->name, 49) &&
+           scanWord(cursor, end, product->category, 49) &&
+           scanFloat(cursor, end, &product->price) &&
+           scanInt(cursor, end, &product->stock) &&
+           scanFloat(cursor, end, &product->discount) &&
+           scanFloat(cursor, end, &product->rating) &&
+           scanText(cursor, end, latestReview, 99);
+}
+
+int scanOrder(const char **cursor, const char *end, void *record) {
+    OrderLine *order = record;
+    return scanInt(cursor, end, &order->orderId) &&
+           scanWord(cursor, end, order->username, 49) &&
+           scanWord(cursor, end, order->productName, 49) &&
+           scanInt(cursor, end, &order->quantity) &&
+           scanFloat(cursor, end, &order->totalPrice) &&
+           scanWord(cursor, end, order->paymentMethod, 19) &&
+           scanText(cursor, end, order->address, 99);
+}
+
+int scanReviewLine(const char **cursor, const char *end, void *record) {
+    ReviewLine *review = record;
+    return scanWord(cursor, end, review->productName, 49) &&
+           scanFloat(cursor, end, &review->rating) &&
+           scanText(cursor, end, review->text, 99);
+}
+
+// The same records read with fscanf, the reference format of each file
+int readUser(FILE *file, void *record) {
+    User *user = record;
+    return fscanf(file, "%49s %49s %d", user->username, user->password, &user->isAdmin) == 3;
+}
+
+int readProduct(FILE *file, void *record) {
+    ProductLine *product = record;
+    char latestReview[100];
+    return fscanf(file, "%49s %49s %f %d %f %f %99[^\n]",
+               product->name,
+               product->category,
+               &product->price,
+               &product->stock,
+               &product->discount,
+               &product->rating,
+               latestReview) == 7;
+}
+
+int readOrder(FILE *file, void *record) {
+    OrderLine *order = record;
+    return fscanf(file, "%d %49s %49s %d %f %19s %99[^\n]",
+               &order->orderId,
+               order->username,
+               order->productName,
+               &order->quantity,
+               &order->totalPrice,
+               order->paymentMethod,
+               order->address) == 7;
+}
+
+int readReviewLine(FILE *file, void *record) {
+    ReviewLine *review = record;
+    return fscanf(file, "%49s %f %99[^\n]", review->productName, &review->rating, review->text) == 3;
+}
+
+// Parse the records of one chunk into its own pool. Stops at the end of
+// the chunk or at the first record the scanner does not accept.
+void *scanTextChunk(void *arg) {
+    TextChunk *chunk = arg;
+    const char *p = chunk->start;
+    while (1) {
+        while (p < chunk->end && isScanSpace(*p)) p++;
+        if (p == chunk->end) break;
+        const char *record = p;
+        if (!chunk->scanner(&p, chunk->end, poolReserve(chunk->pool, chunk->first + chunk->count))) {
+            p = record;
+            break;
+        }
+        chunk->count++;
+    }
+    chunk->stopped = p;
+    return NULL;
+}
+
+// Read a text data file into pool from record *count on. The file is
+// mapped and split on line boundaries into chunks that are parsed in
+// parallel; the first chunk goes straight into the pool and the others
+// are copied in after it, in file order. Reading resumes
+// with fscanf at the first record the fast parser does not accept (an
+// overlong field, an unusual number, a record spread over lines), so the
+// records are exactly what fscanf alone would read. Returns the number of
+// bytes read, or -1 if the file does not exist.
+long long loadTextRecords(const char *filename, Pool *pool, int *count, RecordScanner scanner, RecordReader reader) {
+    long long offset = 0;
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return -1;
+    struct stat info;
+    char *data = MAP_FAILED;
+    if (loadThreads >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data != MAP_FAILED) {
+        long long size = info.st_size;
+        madvise(data, size, MADV_SEQUENTIAL);
+        int threads = loadThreads > 0 ? loadThreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads > LOAD_MAX_THREADS) threads = LOAD_MAX_THREADS;
+        if (threads > size / LOAD_CHUNK_BYTES) threads = (int)(size / LOAD_CHUNK_BYTES);
+        if (threads < 1) threads = 1;
+
+        TextChunk chunks[LOAD_MAX_THREADS];
+        Pool pools[LOAD_MAX_THREADS];
+        pthread_t workers[LOAD_MAX_THREADS];
+        int started[LOAD_MAX_THREADS];
+        const char *start = data;
+        for (int i = 0; i < threads; i++) {
+            const char *end = data + size * (i + 1) / threads;
+            if (i < threads - 1) {
+                const char *newline = memchr(end, '\n', data + size - end);
+                end = newline != NULL ? newline + 1 : data + size;
+            }
+            if (end < start) end = start;
+            pools[i] = (Pool){pool->recordSize, NULL, 0, 0};
+            chunks[i] = (TextChunk){start, end, scanner, i == 0 ? pool : &pools[i], i == 0 ? *count : 0, 0, start};
+            start = end;
+            started[i] = i > 0 && pthread_create(&workers[i], NULL, scanTextChunk, &chunks[i]) == 0;
+        }
+        for (int i = 0; i < threads; i++) {
+            if (started[i]) {
+                pthread_join(workers[i], NULL);
+            } else {
+                scanTextChunk(&chunks[i]);
+            }
+        }
+
+        // Copy the other chunks storage chunk by storage chunk, freeing each
+        // once it is copied, so the records are held in memory about once
+        *count += chunks[0].count;
+        offset = chunks[0].stopped - data;
+        int complete = chunks[0].stopped == chunks[0].end;
+        for (int i = 1; i < threads; i++) {
+            TextChunk *chunk = &chunks[i];
+            for (int first = 0; first < chunk->count; first += POOL_CHUNK_SIZE) {
+                int records = chunk->count - first < POOL_CHUNK_SIZE ? chunk->count - first : POOL_CHUNK_SIZE;
+                char *source = pools[i].chunks[first >> POOL_CHUNK_SHIFT];
+                if (complete) {
+                    for (int r = 0; r < records; r++) {
+                        memcpy(poolReserve(pool, *count), source + (size_t)r * pool->recordSize, pool->recordSize);
+                        (*count)++;
+                    }
+                }
+                free(source);
+            }
+            free(pools[i].chunks);
+            if (complete) {
+                offset = chunk->stopped - data;
+                complete = chunk->stopped == chunk->end;
+            }
+        }
+        munmap(data, size);
+        if (complete) return offset;
+    }
+#endif
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) return -1;
+    fseek(file, offset, SEEK_SET);
+    while (reader(file, poolReserve(pool, *count))) {
+        (*count)++;
+    }
+    offset = ftell(file);
+    fclose(file);
+    return offset;
+}
+
+// Load users from file
+void loadUsers() {
+    STAT_START();
+    int first = userCount;
+    long long bytes = loadTextRecords(FILENAME_USERS, &userPool, &userCount, scanUser, readUser);
+    if (bytes < 0) {
+        printf("No user data found. Starting with an empty list.\n");
+        return;
+    }
+    for (int i = first; i < userCount; i++) {
+        if (findUser(userAt(i)->username) != -1) {
+            slotListAppend(&duplicateUsers, i);
+        } else {
+            indexInsert(&userIndex, userAt(i)->username, i);
+        }
+    }
+    STAT_RECORD(STAT_LOAD_USERS, bytes);
+}
+
+// Save users to file
+void saveUsers() {
+    STAT_START();
+    FILE *file = openReplacement(FILENAME_USERS, "w");
+    if (file == NULL) {
+        printf("Error saving user data.\n");
+        return;
+    }
+    for (int i = 0; i < userCount; i++) {
+        fprintf(file, "%s %s %d\n", userAt(i)->username, userAt(i)->password, userAt(i)->isAdmin);
+    }
+#ifndef NO_STATS
+    long bytes = ftell(file);
+#endif
+    if (!replaceFile(file, FILENAME_USERS, 1)) printf("Error saving user data.\n");
+    STAT_RECORD(STAT_SAVE_USERS, bytes);
+}
+
+// Load products from file
+void loadProducts() {
+    STAT_START();
+    Pool lines = {sizeof(ProductLine), NULL, 0, 0};
+    int count = 0;
+    long long bytes = loadTextRecords(FILENAME_PRODUCTS, &lines, &count, scanProduct, readProduct);
+    if (bytes < 0) {
+        printf("No product data found. Starting with an empty list.\n");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        ProductLine *line = (ProductLine *)(lines.chunks[i >> POOL_CHUNK_SHIFT] +
+                                            (size_t)(i & (POOL_CHUNK_SIZE - 1)) * sizeof(ProductLine));
+        Product *product = poolReserve(&productPool, productCount);
+        memset(product, 0, sizeof(Product));
+        strcpy(product->name, line->name);
+        product->category = categoryId(line->category);
+        product->price = line->price;
+        product->stock = line->stock;
+        product->discount = line->discount;
+        // Ratings are rebuilt from the reviews by loadReviews
+        product->latestReview = -1;
+        indexInsert(&productIndex, product->name, productCount);
+        productCount++;
+        activeProductCount++;
+    }
+    for (int i = 0; i < lines.chunkCount; i++) free(lines.chunks[i]);
+    free(lines.chunks);
+    buildSearchIndexes();
+    STAT_RECORD(STAT_LOAD_PRODUCTS, bytes);
+}
+
+// Save products to file
+void saveProducts() {
+    STAT_START();
+    FILE *file = openReplacement(FILENAME_PRODUCTS, "w");
+    if (file == NULL) {
+        printf("Error saving product data.\n");
+        return;
+    }
+    for (int i = 0; i < productCount; i++) {
+        if (productAt(i)->deleted) continue;
+        fprintf(file, "%s %s %.2f %d %.2f %.2f %s\n",
+                productAt(i)->name,
+                categories[productAt(i)->category].name,
+                productAt(i)->price,
+                productAt(i)->stock,
+                productAt(i)->discount,
+                productAt(i)->rating,
+                latestReviewText(i));
+    }
+#ifndef NO_STATS
+    long bytes = ftell(file);
+#endif
+    if (!replaceFile(file, FILENAME_PRODUCTS, 1)) printf("Error saving product data.\n");
+    STAT_RECORD(STAT_SAVE_PRODUCTS, bytes);
+}
+
+// Load orders from file. The lines are only parsed here; the products and
+// users they name may still be loading, so resolveOrders turns them into
+// orders afterwards.
+void loadOrders() {
+    STAT_START();
+    long long bytes = loadTextRecords(FILENAME_ORDERS, &orderLinePool, &orderLineCount, scanOrder, readOrder);
+    if (bytes < 0) {
+        printf("No order data found. Starting with an empty list.\n");
+        return;
+    }
+    STAT_RECORD(STAT_LOAD_ORDERS, bytes);
+}
+
+// Turn the lines read by loadOrders into orders and index them
+void resolveOrders() {
+    for (int i = 0; i < orderLineCount; i++) {
+        OrderLine *line = (OrderLine *)(orderLinePool.chunks[i >> POOL_CHUNK_SHIFT] +
+                                        (size_t)(i & (POOL_CHUNK_SIZE - 1)) * sizeof(OrderLine));
+        orderFromLine(line, poolReserve(&orderPool, orderCount));
+        if (orderAt(orderCount)->orderId > lastOrderId) {
+            lastOrderId = orderAt(orderCount)->orderId;
+        }
+        indexOrder(orderCount);
+        orderCount++;
+    }
+    for (int i = 0; i < orderLinePool.chunkCount; i++) free(orderLinePool.chunks[i]);
+    free(orderLinePool.chunks);
+    orderLinePool = (Pool){sizeof(OrderLine), NULL, 0, 0};
+    orderLineCount = 0;
+}
+
+// Load reviews from file. Data written before reviews had a file of their
+// own keeps a product's one review in products.txt instead.
+void loadReviews() {
+    Pool lines = {sizeof(ReviewLine), NULL, 0, 0};
+    int count = 0;
+    if (loadTextRecords(FILENAME_REVIEWS, &lines, &count, scanReviewLine, readReviewLine) < 0) {
+        migrateProductReviews();
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        ReviewLine *line = (ReviewLine *)(lines.chunks[i >> POOL_CHUNK_SHIFT] +
+                                          (size_t)(i & (POOL_CHUNK_SIZE - 1)) * sizeof(ReviewLine));
+        int slot = findProduct(line->productName);
+        if (slot != -1) addReview(slot, line->rating, line->text);
+    }
+    for (int i = 0; i < lines.chunkCount; i++) free(lines.chunks[i]);
+    free(lines.chunks);
+}
+
+// Save the reviews of every product still sold, oldest first
+void saveReviews() {
+    FILE *file = openReplacement(FILENAME_REVIEWS, "w");
+    if (file == NULL) {
+        printf("Error saving review data.\n");
+        return;
+    }
+    for (int i = 0; i < reviewCount; i++) {
+        Review *review = reviewAt(i);
+        if (productAt(review->product)->deleted) continue;
+        fprintf(file, "%s %.2f %s\n", productAt(review->product)->name, review->rating, review->text);
+    }
+    if (!replaceFile(file, FILENAME_REVIEWS, 1)) printf("Error saving review data.\n");
+}
+
+// Turn the rating and review text stored in an old products.txt into each
+// product's first review. The file is read again with the loader's own
+// format, so the nth record read is the nth product loaded.
+void migrateProductReviews() {
+    FILE *file = fopen(FILENAME_PRODUCTS, "r");
+    if (file == NULL) return;
+    ProductLine product;
+    char text[100];
+    for (int slot = 0; slot < productCount &&
+                       fscanf(file, "%49s %49s %f %d %f %f %99[^\n]", product.name, product.category, &product.price,
+                              &product.stock, &product.discount, &product.rating, text) == 7;
+         slot++) {
+        text[strcspn(text, "\r")] = '\0';
+        if (product.rating != 0 || strcmp(text, "No reviews yet.") != 0) {
+            addReview(slot, product.rating, text);
+        }
+    }
+    fclose(file);
+}
+
+// Number of entries in an open history index
+int historyEntryCount(FILE *index) {
+    fseek(index, 0, SEEK_END);
+    return (int)(ftell(index) / (long)sizeof(HistoryIndexEntry));
+}
+
+// Read the entry at position from an open history index
+int readHistoryEntry(FILE *index, int position, HistoryIndexEntry *entry) {
+    return fseek(index, (long)position * sizeof(HistoryIndexEntry), SEEK_SET) == 0 &&
+           fread(entry, sizeof(HistoryIndexEntry), 1, index) == 1;
+}
+
+// Find the total for key in a sales table, adding an empty one if needed
+SalesTotal *salesTotalFor(SalesTable *table, const char *key) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        SalesTable grown = {NULL, table->capacity ? table->capacity * 2 : 256, 0};
+        grown.entries = calloc(grown.capacity, sizeof(SalesTotal));
+        if (grown.entries == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < table->capacity; i++) {
+            SalesTotal *old = &table->entries[i];
+            if (old->orders == 0) continue;
+            int j = old->hash & (grown.capacity - 1);
+            while (grown.entries[j].orders != 0) j = (j + 1) & (grown.capacity - 1);
+            grown.entries[j] = *old;
+        }
+        grown.count = table->count;
+        free(table->entries);
+        *table = grown;
+    }
+    unsigned int hash = hashString(key);
+    int mask = table->capacity - 1;
+    int i = hash & mask;
+    while (table->entries[i].orders != 0) {
+        if (table->entries[i].hash == hash && strcmp(table->entries[i].key, key) == 0) {
+            return &table->entries[i];
+        }
+        i = (i + 1) & mask;
+    }
+    // The caller counts the order, which marks the bucket as used
+    strncpy(table->entries[i].key, key, sizeof(table->entries[i].key) - 1);
+    table->entries[i].hash = hash;
+    table->count++;
+    return &table->entries[i];
+}
+
+// Add one order to the total for key
+void addSale(SalesTable *table, const char *key, int quantity, long long cents) {
+    SalesTotal *total = salesTotalFor(table, key);
+    total->orders++;
+    total->units += quantity;
+    total->cents += cents;
+}
+
+// Read the field named label at *cursor, up to the next ", ", into out,
+// cut to width - 1 characters. Returns 0 if the line has another field there.
+int takeHistoryField(const char **cursor, const char *end, const char *label, char *out, int width) {
+    size_t labelLength = strlen(label);
+    const char *p = *cursor;
+    if (end - p < (long)labelLength || memcmp(p, label, labelLength) != 0) return 0;
+    p += labelLength;
+    const char *stop = p;
+    while ((stop = memchr(stop, ',', end - stop)) != NULL && (stop + 1 == end || stop[1] != ' ')) stop++;
+    if (stop == NULL) stop = end;
+    int length = stop - p < width - 1 ? (int)(stop - p) : width - 1;
+    memcpy(out, p, length);
+    out[length] = '\0';
+    *cursor = stop < end ? stop + 2 : end;
+    return 1;
+}
+
+// Parse one order history line. Lines written before order IDs and dates
+// were recorded start at the user and leave date empty.
+int parseHistoryLine(const char *p, const char *end, HistoryLine *line) {
+    char number[24], total[32];
+    line->date[0] = '\0';
+    if (takeHistoryField(&p, end, "Order ID: ", number, sizeof(number)) &&
+        !takeHistoryField(&p, end, "Date: ", line->date, sizeof(line->date))) {
+        return 0;
+    }
+    if (!takeHistoryField(&p, end, "User: ", line->username, sizeof(line->username)) ||
+        !takeHistoryField(&p, end, "Product: ", line->productName, sizeof(line->productName)) ||
+        !takeHistoryField(&p, end, "Qty: ", number, sizeof(number)) ||
+        !takeHistoryField(&p, end, "Total: ", total, sizeof(total)) ||
+        !takeHistoryField(&p, end, "Method: ", line->paymentMethod, sizeof(line->paymentMethod))) {
+        return 0;
+    }
+    line->quantity = atoi(number);
+    double value = atof(total);
+    line->cents = (long long)(value * 100 + (value < 0 ? -0.5 : 0.5));
+    return 1;
+}
+
+// Fold one history line into a report. A basket is a run of lines one
+// checkout wrote: same user, same date and time.
+void addHistoryLine(HistorySlice *slice, const char *start, const char *end) {
+    SalesReport *report = &slice->report;
+    HistoryLine line;
+    report->lines++;
+    if (!parseHistoryLine(start, end, &line)) {
+        report->skipped++;
+        return;
+    }
+    char basket[sizeof(line.date) + sizeof(line.username)];
+    basket[0] = '\0';
+    if (line.date[0] != '\0') sprintf(basket, "%s|%s", line.date, line.username);
+    if (basket[0] == '\0' || strcmp(basket, slice->lastBasket) != 0) report->baskets++;
+    if (report->orders == 0) strcpy(slice->firstBasket, basket);
+    strcpy(slice->lastBasket, basket);
+
+    char day[11] = "(no date)";
+    if (line.date[0] != '\0') snprintf(day, sizeof(day), "%.10s", line.date);
+    report->orders++;
+    report->units += line.quantity;
+    report->cents += line.cents;
+    addSale(&report->products, line.productName, line.quantity, line.cents);
+    addSale(&report->users, line.username, line.quantity, line.cents);
+    addSale(&report->methods, line.paymentMethod, line.quantity, line.cents);
+    addSale(&report->days, day, line.quantity, line.cents);
+}
+
+// Aggregate the history lines that start in [start, end) of the file,
+// reading it ANALYTICS_BLOCK_BYTES at a time. The line running into end is
+// finished here; the one running into start belongs to the slice before.
+void *analyzeHistorySlice(void *arg) {
+    HistorySlice *slice = arg;
+    FILE *file = fopen(FILENAME_ORDER_HISTORY, "rb");
+    char *block = malloc(ANALYTICS_BLOCK_BYTES);
+    if (file == NULL || block == NULL) {
+        if (file != NULL) fclose(file);
+        free(block);
+        slice->failed = 1;
+        return NULL;
+    }
+
+    // Read from the byte before start: if it ends a line, start begins one
+    long long offset = slice->start > 0 ? slice->start - 1 : 0; // File offset of block[0]
+    int skipping = slice->start > 0;
+    size_t length = 0;
+    fseek(file, offset, SEEK_SET);
+    while (1) {
+        size_t wanted = ANALYTICS_BLOCK_BYTES - length;
+        size_t got = fread(block + length, 1, wanted, file);
+        int atEnd = got < wanted;
+        length += got;
+
+        char *p = block, *limit = block + length;
+        int done = 0;
+        while (p < limit) {
+            char *newline = memchr(p, '\n', limit - p);
+            if (skipping) {
+                if (newline == NULL) {
+                    p = limit;
+                    break;
+                }
+                skipping = 0;
+                p = newline + 1;
+                continue;
+            }
+            if (offset + (p - block) >= slice->end) {
+                done = 1;
+                break;
+            }
+            if (newline == NULL) {
+                if (!atEnd) break;
+                newline = limit;
+            }
+            addHistoryLine(slice, p, newline);
+            p = newline < limit ? newline + 1 : limit;
+        }
+        if (done || atEnd) break;
+
+        // Keep the unfinished line for the next read. A line longer than
+        // the whole block is not an order line; skip to its end.
+        offset += p - block;
+        length = limit - p;
+        if (length == ANALYTICS_BLOCK_BYTES) {
+            slice->report.lines++;
+            slice->report.skipped++;
+            skipping = 1;
+            offset += length;
+            length = 0;
+        }
+        memmove(block, p, length);
+    }
+    free(block);
+    fclose(file);
+    return NULL;
+}
+
+// Add every total of one table into another and free the first
+void mergeSalesTable(SalesTable *into, SalesTable *from) {
+    for (int i = 0; i < from->capacity; i++) {
+        SalesTotal *source = &from->entries[i];
+        if (source->orders == 0) continue;
+        SalesTotal *total = salesTotalFor(into, source->key);
+        total->orders += source->orders;
+        total->units += source->units;
+        total->cents += source->cents;
+    }
+    free(from->entries);
+    from->entries = NULL;
+    from->capacity = from->count = 0;
+}
+
+// Stream the order history and total its revenue per product, user,
+// payment method and day. The file is cut into one slice per thread, each
+// read in blocks into the thread's own tables, and the tables are merged
+// at the end, so memory grows with the number of distinct keys and not
+// with the history. threads 0 means loadThreads, or one per CPU. Returns 0 if there is no
+// history to read.
+int analyzeHistory(int threads, SalesReport *report) {
+    memset(report, 0, sizeof(*report));
+    FILE *file = fopen(FILENAME_ORDER_HISTORY, "rb");
+    if (file == NULL) return 0;
+    fseek(file, 0, SEEK_END);
+    long long size = ftell(file);
+    fclose(file);
+    if (size <= 0) return 0;
+
+    double started = nowSeconds();
+#ifndef _WIN32
+    if (threads <= 0) threads = loadThreads > 0 ? loadThreads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    threads = 1;
+#endif
+    if (threads > LOAD_MAX_THREADS) threads = LOAD_MAX_THREADS;
+    if (threads > size / LOAD_CHUNK_BYTES) threads = (int)(size / LOAD_CHUNK_BYTES);
+    if (threads < 1) threads = 1;
+
+    HistorySlice *slices = calloc(threads, sizeof(HistorySlice));
+    if (slices == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < threads; i++) {
+        slices[i].start = size * i / threads;
+        slices[i].end = size * (i + 1) / threads;
+    }
+#ifndef _WIN32
+    pthread_t workers[LOAD_MAX_THREADS];
+    int running[LOAD_MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        running[i] = i > 0 && pthread_create(&workers[i], NULL, analyzeHistorySlice, &slices[i]) == 0;
+    }
+    for (int i = 0; i < threads; i++) {
+        if (running[i]) {
+            pthread_join(workers[i], NULL);
+        } else {
+            analyzeHistorySlice(&slices[i]);
+        }
+    }
+#else
+    analyzeHistorySlice(&slices[0]);
+#endif
+
+    *report = slices[0].report;
+    int failed = slices[0].failed;
+    const char *lastBasket = slices[0].lastBasket;
+    for (int i = 1; i < threads; i++) {
+        SalesReport *part = &slices[i].report;
+        failed |= slices[i].failed;
+        report->lines += part->lines;
+        report->skipped += part->skipped;
+        report->orders += part->orders;
+        report->units += part->units;
+        report->cents += part->cents;
+        report->baskets += part->baskets;
+        // A checkout cut in two by a slice boundary is one basket
+        if (part->orders > 0) {
+            if (slices[i].firstBasket[0] != '\0' && strcmp(slices[i].firstBasket, lastBasket) == 0) {
+                report->baskets--;
+            }
+            lastBasket = slices[i].lastBasket;
+        }
+        mergeSalesTable(&report->products, &part->products);
+        mergeSalesTable(&report->users, &part->users);
+        mergeSalesTable(&report->methods, &part->methods);
+        mergeSalesTable(&report->days, &part->days);
+    }
+    free(slices);
+    report->threads = threads;
+    report->bytes = size;
+    report->seconds = nowSeconds() - started;
+    if (failed) printf("Error reading order history.\n");
+    return !failed;
+}
+
+// Order sales totals by revenue, highest first, then by key
+int compareSalesRevenue(const void *a, const void *b) {
+    const SalesTotal *x = *(SalesTotal *const *)a, *y = *(SalesTotal *const *)b;
+    if (x->cents != y->cents) return x->cents > y->cents ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+// Order sales totals by key
+int compareSalesKeys(const void *a, const void *b) {
+    return strcmp((*(SalesTotal *const *)a)->key, (*(SalesTotal *const *)b)->key);
+}
+
+// Format the totals of a table, sorted by compare, at most limit of them
+void formatSalesTable(Buffer *out, const char *title, SalesTable *table, int limit, int (*compare)(const void *, const void *)) {
+    SalesTotal **sorted = malloc((table->count + 1) * sizeof(SalesTotal *));
+    if (sorted == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    int count = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].orders != 0) sorted[count++] = &table->entries[i];
+    }
+    qsort(sorted, count, sizeof(SalesTotal *), compare);
+    if (count > limit) count = limit;
+
+    bufferPrintf(out, "\n%s\n", title);
+    bufferPrintf(out, "%-24s %10s %10s %14s\n", "", "Orders", "Units", "Revenue");
+    for (int i = 0; i < count; i++) {
+        SalesTotal *total = sorted[i];
+        bufferPrintf(out, "%-24s %10lld %10lld %14.2f\n", total->key, total->orders, total->units, total->cents / 100.0);
+    }
+    free(sorted);
+}
+
+// Format a sales report for the screen
+void formatSalesReport(Buffer *out, SalesReport *report) {
+    bufferPrintf(out, "\nSales Report\n");
+    bufferPrintf(out, "Orders: %lld\nUnits: %lld\nRevenue: %.2f\n", report->orders, report->units, report->cents / 100.0);
+    if (report->baskets > 0) {
+        bufferPrintf(out, "Baskets: %lld\nAverage basket: %.2f items, %.2f units, %.2f\n", report->baskets,
+                     (double)report->orders / report->baskets, (double)report->units / report->baskets,
+                     report->cents / 100.0 / report->baskets);
+    }
+    if (report->skipped > 0) {
+        bufferPrintf(out, "Unreadable lines skipped: %lld of %lld\n", report->skipped, report->lines);
+    }
+    formatSalesTable(out, "Revenue by Payment Method:", &report->methods, report->methods.count, compareSalesRevenue);
+    formatSalesTable(out, "Top Products by Revenue:", &report->products, ANALYTICS_TOP, compareSalesRevenue);
+    formatSalesTable(out, "Top Customers by Revenue:", &report->users, ANALYTICS_TOP, compareSalesRevenue);
+    formatSalesTable(out, "Daily Totals:", &report->days, report->days.count, compareSalesKeys);
+}
+
+// Free the tables of a sales report
+void freeSalesReport(SalesReport *report) {
+    free(report->products.entries);
+    free(report->users.entries);
+    free(report->methods.entries);
+    free(report->days.entries);
+    memset(report, 0, sizeof(*report));
+}
+
+// Index history lines from offset onwards. Lines written before the index
+// existed have no date, and the oldest ones no order ID; those get zeros.
+void indexHistoryTail(FILE *history, FILE *index, long long offset) {
+    char line[500];
+    fseek(history, offset, SEEK_SET);
+    while (fgets(line, sizeof(line), history)) {
+        HistoryIndexEntry entry;
+        struct tm date;
+        memset(&entry, 0, sizeof(entry));
+        memset(&date, 0, sizeof(date));
+        entry.offset = offset;
+        entry.length = (int)strlen(line);
+        sscanf(line, "Order ID: %d", &entry.orderId);
+        if (sscanf(line, "Order ID: %*d, Date: %d-%d-%d %d:%d:%d", &date.tm_year, &date.tm_mon, &date.tm_mday,
+                   &date.tm_hour, &date.tm_min, &date.tm_sec) == 6) {
+            date.tm_year -= 1900;
+            date.tm_mon -= 1;
+            date.tm_isdst = -1;
+            entry.timestamp = mktime(&date);
+        }
+        // A line longer than the buffer comes in pieces, and the rest of
+        // it belongs to this entry
+        int complete = entry.length > 0 && line[entry.length - 1] == '\n';
+        while (!complete && fgets(line, sizeof(line), history)) {
+            int piece = (int)strlen(line);
+            entry.length += piece;
+            complete = piece > 0 && line[piece - 1] == '\n';
+        }
+        fwrite(&entry, sizeof(entry), 1, index);
+        offset += entry.length;
+    }
+}
+
+// Load the last order ID written to the history file from the history
+// index. Only lines the index does not cover yet are read, so this is a
+// constant-time check once the index is up to date.
+void loadLastSavedOrderId() {
+    FILE *history = fopen(FILENAME_ORDER_HISTORY, "rb");
+    if (history == NULL) return;
+    fseek(history, 0, SEEK_END);
+    long long historySize = ftell(history);
+
+    FILE *index = fopen(FILENAME_HISTORY_INDEX, "r+b");
+    if (index == NULL) {
+        index = fopen(FILENAME_HISTORY_INDEX, "w+b");
+    }
+    if (index == NULL) {
+        printf("Error opening order history index.\n");
+        fclose(history);
+        return;
+    }
+
+    HistoryIndexEntry last;
+    long long covered = 0;
+    int count = historyEntryCount(index);
+    if (count > 0 && readHistoryEntry(index, count - 1, &last)) {
+        covered = last.offset + last.length;
+    }
+    if (covered > historySize) {
+        // The history file was replaced; start the index over
+        fclose(index);
+        index = fopen(FILENAME_HISTORY_INDEX, "w+b");
+        covered = 0;
+        if (index == NULL) {
+            printf("Error opening order history index.\n");
+            fclose(history);
+            return;
+        }
+    }
+    if (covered < historySize) {
+        fseek(index, 0, SEEK_END);
+        indexHistoryTail(history, index, covered);
+    }
+
+    count = historyEntryCount(index);
+    if (count > 0 && readHistoryEntry(index, count - 1, &last)) {
+        lastSavedOrderId = last.orderId;
+    }
+    fclose(index);
+    fclose(history);
+}
+
+// Save orders to file
+void saveOrders() {
+    STAT_START();
+    FILE *file = openReplacement(FILENAME_ORDERS, "w");
+    if (file == NULL) {
+        printf("Error saving order data.\n");
+        return;
+    }
+    for (int i = 0; i < orderCount; i++) {
+        Order *order = orderAt(i);
+        fprintf(file, "%d %s %s %d %.2f %s %s\n",
+                order->orderId,
+                customers[order->customer].username,
+                productAt(order->product)->name,
+                order->quantity,
+                order->totalPrice,
+                orderMethod(order),
+                stringAt(order->address));
+    }
+#ifndef NO_STATS
+    long bytes = ftell(file);
+#endif
+    if (!replaceFile(file, FILENAME_ORDERS, 1)) printf("Error saving order data.\n");
+    STAT_RECORD(STAT_SAVE_ORDERS, bytes);
+}
+
+// Save order history to file
+void saveOrderHistory() {
+    STAT_START();
+    FILE *file = fopen(FILENAME_ORDER_HISTORY, "ab");
+    if (file == NULL) {
+        printf("Error saving order history.\n");
+        return;
+    }
+    FILE *index = fopen(FILENAME_HISTORY_INDEX, "ab");
+    if (index == NULL) {
+        printf("Error saving order history index.\n");
+        fclose(file);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long long offset = ftell(file);
+#ifndef NO_STATS
+    long long firstOffset = offset;
+#endif
+
+    time_t now = time(NULL);
+    char date[20];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    // Orders are kept in ID order, so skip straight past the saved ones
+    int low = 0, high = orderCount;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (orderAt(mid)->orderId <= lastSavedOrderId) low = mid + 1;
+        else high = mid;
+    }
+
+    for (int i = low; i < orderCount; i++) {
+        Order *order = orderAt(i);
+        if (order->status == ORDER_CANCELLED) continue; // Never sold
+        int length = fprintf(file, "Order ID: %d, Date: %s, User: %s, Product: %s, Qty: %d, Total: %.2f, Method: %s, Address: %s\n",
+                             order->orderId,
+                             date,
+                             customers[order->customer].username,
+                             productAt(order->product)->name,
+                             order->quantity,
+                             order->totalPrice,
+                             orderMethod(order),
+                             stringAt(order->address));
+
+        HistoryIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.orderId = order->orderId;
+        entry.length = length;
+        entry.offset = offset;
+        entry.timestamp = now;
+        fwrite(&entry, sizeof(entry), 1, index);
+        offset += length;
+
+        // Update the last saved order ID
+        lastSavedOrderId = order->orderId;
+    }
+
+    // The history lines go out, and unless syncPolicy is SYNC_NONE reach
+    // the disk, before their index entries
+    fflush(file);
+#ifndef _WIN32
+    if (syncPolicy != SYNC_NONE) fsync(fileno(file));
+#endif
+    fclose(file);
+    fflush(index);
+#ifndef _WIN32
+    if (syncPolicy != SYNC_NONE) fsync(fileno(index));
+#endif
+    fclose(index);
+    STAT_RECORD(STAT_SAVE_HISTORY, offset - firstOffset);
+}
+
+// Open the change log for appending new records
+void openChangeLog() {
+    changeLog = fopen(FILENAME_CHANGE_LOG, "a");
+    if (changeLog == NULL) {
+        printf("Error opening change log. Changes will not be saved.\n");
+        return;
+    }
+    fseek(changeLog, 0, SEEK_END);
+    changeLogBytes = ftell(changeLog);
+    if (changeLogBytes == 0) {
+        changeLogBytes = fprintf(changeLog, "generation %d\n", logGeneration);
+    }
+}
+
+// Append one change record. Records carry absolute values (the new stock,
+// the new discount, ...) or IDs, so replaying a record twice is harmless;
+// reviews are the exception, which the generation line guards against.
+void logChange(const char *format, ...) {
+    if (changeLog == NULL) return;
+
+    va_list args;
+    if (changeBatchOpen) {
+        va_start(args, format);
+        int length = vsnprintf(NULL, 0, format, args);
+        va_end(args);
+        if (changeBatchLength + length + 1 > changeBatchCapacity) {
+            int newCapacity = (changeBatchLength + length + 1) * 2;
+            char *grown = realloc(changeBatch, newCapacity);
+            if (grown == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            changeBatch = grown;
+            changeBatchCapacity = newCapacity;
+        }
+        va_start(args, format);
+        vsnprintf(changeBatch + changeBatchLength, length + 1, format, args);
+        va_end(args);
+        changeBatchLength += length;
+        return;
+    }
+
+    STAT_START();
+    va_start(args, format);
+    int written = vfprintf(changeLog, format, args);
+    va_end(args);
+
+    if (written > 0) {
+        __atomic_add_fetch(&changeLogBytes, written, __ATOMIC_RELAXED);
+    }
+    changeLogWritten();
+    STAT_RECORD(STAT_LOG_CHANGE, written > 0 ? written : 0);
+    if (!compactionDeferred) {
+        compactChangeLogIfDue();
+    }
+}
+
+// Collect the following change records and write them in one go
+void beginChangeBatch() {
+    changeBatchOpen = 1;
+    changeBatchLength = 0;
+}
+
+// Write the records collected since beginChangeBatch as a single append
+void endChangeBatch() {
+    changeBatchOpen = 0;
+    if (changeLog == NULL || changeBatchLength == 0) return;
+
+    STAT_START();
+    fwrite(changeBatch, 1, changeBatchLength, changeLog);
+    __atomic_add_fetch(&changeLogBytes, changeBatchLength, __ATOMIC_RELAXED);
+    changeLogWritten();
+    STAT_RECORD(STAT_LOG_CHANGE, changeBatchLength);
+    changeBatchLength = 0;
+    if (!compactionDeferred) {
+        compactChangeLogIfDue();
+    }
+}
+
+// Compact the change log once it has outgrown CHANGE_LOG_COMPACT_BYTES.
+// Compaction rewrites the search indexes, so server sessions only call
+// this while no other session can be reading them.
+void compactChangeLogIfDue() {
+    if (changeLogBytes >= CHANGE_LOG_COMPACT_BYTES) {
+        compactChangeLog();
+    }
+}
+
+// Apply the records left in the change log on top of the loaded data files
+void replayChangeLog() {
+    STAT_START();
+    FILE *file = fopen(FILENAME_CHANGE_LOG, "r");
+    if (file == NULL) return;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        char type[16], name[50], text[100] = "";
+        int id, value;
+        float amount;
+
+        if (sscanf(line, "%15s", type) != 1) continue;
+
+        if (strcmp(type, "generation") == 0) {
+            // A compaction that saved the snapshot but stopped before
+            // emptying the log leaves a log of an older generation
+            if (sscanf(line, "generation %d", &value) != 1) continue;
+            if (value < logGeneration) break;
+            logGeneration = value;
+
+        } else if (strcmp(type, "user") == 0) {
+            User user;
+            if (sscanf(line, "user %49s %49s %d", user.username, user.password, &user.isAdmin) != 3) continue;
+            if (findUser(user.username) == -1) appendUser(&user);
+
+        } else if (strcmp(type, "product") == 0) {
+            // Older logs also carry a rating and review text, which were
+            // always zero and "No reviews yet." for new products
+            Product product;
+            char category[50];
+            memset(&product, 0, sizeof(product));
+            if (sscanf(line, "product %49s %49s %f %d %f", product.name, category,
+                       &product.price, &product.stock, &product.discount) != 5) continue;
+            product.category = categoryId(category);
+            product.latestReview = -1;
+            int i = findProduct(product.name);
+            if (i == -1) {
+                appendProduct(&product);
+            } else {
+                // Keep the reviews the product already has
+                Product *existing = productAt(i);
+                product.rating = existing->rating;
+                product.reviewCount = existing->reviewCount;
+                product.ratingSum = existing->ratingSum;
+                product.latestReview = existing->latestReview;
+                unindexProductForSearch(i);
+                *existing = product;
+                indexProductForSearch(i);
+            }
+
+        } else if (strcmp(type, "stock") == 0) {
+            if (sscanf(line, "stock %49s %d", name, &value) != 2) continue;
+            int i = findProduct(name);
+            if (i != -1) {
+                productAt(i)->stock = value;
+                syncProductColumns(i);
+            }
+
+        } else if (strcmp(type, "discount") == 0) {
+            if (sscanf(line, "discount %49s %f", name, &amount) != 2) continue;
+            int i = findProduct(name);
+            if (i != -1) {
+                productAt(i)->discount = amount;
+                syncProductColumns(i);
+            }
+
+        } else if (strcmp(type, "review") == 0) {
+            if (sscanf(line, "review %49s %f %99[^\n]", name, &amount, text) < 2) continue;
+            int i = findProduct(name);
+            if (i != -1) addReview(i, amount, text);
+
+        } else if (strcmp(type, "remove") == 0) {
+            if (sscanf(line, "remove %49s", name) != 1) continue;
+            int i = findProduct(name);
+            if (i != -1) deleteProductAt(i);
+
+        } else if (strcmp(type, "order") == 0) {
+            OrderLine orderLine;
+            int fields = sscanf(line, "order %d %49s %49s %d %f %99[^\n]",
+                                &orderLine.orderId, orderLine.username, orderLine.productName,
+                                &orderLine.quantity, &orderLine.totalPrice, orderLine.address);
+            if (fields < 5 || orderLine.orderId <= lastOrderId) continue;
+            if (fields == 5) orderLine.address[0] = '\0';
+            strcpy(orderLine.paymentMethod, "Pending");
+            Order order;
+            orderFromLine(&orderLine, &order);
+            appendOrder(&order);
+
+        } else if (strcmp(type, "paid") == 0) {
+            if (sscanf(line, "paid %d %19[^\n]", &id, text) != 2) continue;
+            int i = findOrder(id);
+            if (i == -1 || orderAt(i)->status != ORDER_PENDING) continue;
+            orderAt(i)->status = ORDER_PAID;
+            orderAt(i)->paymentMethod = internString(text);
+            dropPending(&customers[orderAt(i)->customer], i);
+
+        } else if (strcmp(type, "cancel") == 0) {
+            if (sscanf(line, "cancel %d", &id) != 1) continue;
+            int i = findOrder(id);
+            if (i == -1 || orderAt(i)->status != ORDER_PENDING) continue;
+            orderAt(i)->status = ORDER_CANCELLED;
+            dropPending(&customers[orderAt(i)->customer], i);
+        }
+    }
+    STAT_RECORD(STAT_REPLAY_LOG, ftell(file));
+    fclose(file);
+}
+
+// Fold the change log into a fresh snapshot and start an empty log. If
+// the snapshot cannot be saved the log is kept, since it is then the only
+// copy of the changes.
+void compactChangeLog() {
+    logGeneration++;
+    if (!saveSnapshot()) {
+        logGeneration--;
+        return;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_lock(&syncLock);
+#endif
+    if (changeLog != NULL) {
+        fclose(changeLog);
+    }
+    changeLog = fopen(FILENAME_CHANGE_LOG, "w");
+    long header = changeLog != NULL ? fprintf(changeLog, "generation %d\n", logGeneration) : 0;
+    __atomic_store_n(&changeLogBytes, header, __ATOMIC_RELAXED);
+    // Everything logged so far is in the snapshot, which is on disk
+    changeDurable = changeSequence;
+#ifndef _WIN32
+    pthread_cond_broadcast(&changeSynced);
+    pthread_mutex_unlock(&syncLock);
+#endif
+    if (changeLog == NULL) {
+        printf("Error opening change log. Changes will not be saved.\n");
+    }
+}
+
+// Count a record (or batch) just written to the change log and make it as
+// durable as syncPolicy asks. Unless commitsDeferred is set, this returns
+// once the record is on disk.
+void changeLogWritten() {
+    fflush(changeLog);
+#ifndef _WIN32
+    pthread_mutex_lock(&syncLock);
+    long long sequence = ++changeSequence;
+    if (syncPolicy == SYNC_ALWAYS) {
+        STAT_START();
+        fsync(fileno(changeLog));
+        changeSyncs++;
+        changeDurable = sequence;
+        STAT_RECORD(STAT_SYNC_LOG, 0);
+    }
+    pthread_cond_broadcast(&commandsProgressed);
+    pthread_mutex_unlock(&syncLock);
+    if (!commitsDeferred) waitForCommit(sequence);
+#endif
+}
+
+// Group commit: wait until change record sequence is on disk. The first
+// waiter syncs the log for everyone, and one fsync covers every record
+// written before it starts; records written during it wait for the next.
+// While other server commands are still running, that fsync is held back
+// up to syncWindow microseconds so their records can share it.
+void waitForCommit(long long sequence) {
+#ifndef _WIN32
+    if (syncPolicy != SYNC_GROUP) return;
+    pthread_mutex_lock(&syncLock);
+    while (changeDurable < sequence) {
+        if (changeSyncRunning) {
+            pthread_cond_wait(&changeSynced, &syncLock);
+            continue;
+        }
+        changeSyncRunning = 1;
+        if (syncWindow > 0 && commandsRunning > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)syncWindow * 1000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            while (commandsRunning > 0 && pthread_cond_timedwait(&commandsProgressed, &syncLock, &deadline) == 0);
+        }
+
+        // Sync a duplicate descriptor, so compaction can swap the log meanwhile
+        long long covered = changeSequence;
+        int fd = changeLog != NULL ? dup(fileno(changeLog)) : -1;
+        pthread_mutex_unlock(&syncLock);
+        STAT_START();
+        if (fd != -1) {
+            fsync(fd);
+            close(fd);
+        }
+        STAT_RECORD(STAT_SYNC_LOG, 0);
+        pthread_mutex_lock(&syncLock);
+        changeSyncs++;
+        if (covered > changeDurable) changeDurable = covered;
+        changeSyncRunning = 0;
+        pthread_cond_broadcast(&changeSynced);
+    }
+    pthread_mutex_unlock(&syncLock);
+#else
+    (void)sequence;
+#endif
+}
+
+// Note that a server command is starting. Returns the number of change
+// records written so far, to compare with commandFinished.
+long long commandStarted() {
+    long long sequence = 0;
+#ifndef _WIN32
+    pthread_mutex_lock(&syncLock);
+    commandsRunning++;
+    sequence = changeSequence;
+    pthread_mutex_unlock(&syncLock);
+#endif
+    return sequence;
+}
+
+// Note that a server command has finished. Returns the number of change
+// records written so far.
+long long commandFinished() {
+    long long sequence = 0;
+#ifndef _WIN32
+    pthread_mutex_lock(&syncLock);
+    commandsRunning--;
+    sequence = changeSequence;
+    pthread_cond_broadcast(&commandsProgressed);
+    pthread_mutex_unlock(&syncLock);
+#endif
+    return sequence;
+}
+
+// Apply a --sync=POLICY or --sync-window=MICROSECONDS option. Returns 0 if
+// the option is not one of these.
+int parseSyncOption(const char *option) {
+    if (strcmp(option, "--sync=none") == 0) {
+        syncPolicy = SYNC_NONE;
+    } else if (strcmp(option, "--sync=always") == 0) {
+        syncPolicy = SYNC_ALWAYS;
+    } else if (strcmp(option, "--sync=group") == 0) {
+        syncPolicy = SYNC_GROUP;
+    } else if (strncmp(option, "--sync-window=", 14) == 0 && parseInteger(option + 14, &syncWindow) && syncWindow >= 0) {
+        return 1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Open a temporary file next to path, for replaceFile to move over it
+FILE *openReplacement(const char *path, const char *mode) {
+    char temp[256];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    return fopen(temp, mode);
+}
+
+// Close a file from openReplacement and rename it over path. Unless
+// syncPolicy is SYNC_NONE the file is on disk before the rename and the
+// rename is on disk before this returns, so a crash at any point leaves
+// either the old file or the new one. If ok is 0 or anything failed, the
+// new file is removed and path is left alone. Returns 1 on success.
+int replaceFile(FILE *file, const char *path, int ok) {
+    char temp[256];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    ok = ok && !ferror(file) && fflush(file) == 0;
+#ifndef _WIN32
+    ok = ok && (syncPolicy == SYNC_NONE || fsync(fileno(file)) == 0);
+#endif
+    if (fclose(file) != 0 || !ok) {
+        remove(temp);
+        return 0;
+    }
+    if (rename(temp, path) != 0) {
+#ifdef _WIN32
+        // Windows will not rename over an existing file
+        remove(path);
+        if (rename(temp, path) != 0) return 0;
+#else
+        // Any other failure leaves the old file in place
+        remove(temp);
+        return 0;
+#endif
+    }
+#ifndef _WIN32
+    if (syncPolicy != SYNC_NONE) {
+        int directory = open(".", O_RDONLY);
+        if (directory != -1) {
+            fsync(directory);
+            close(directory);
+        }
+    }
+#endif
+    return 1;
+}
+
+// Thread body running one startup load
+void *loadTaskWorker(void *arg) {
+    (*(LoadTask *)arg)();
+    return NULL;
+}
+
+// Run independent loads at the same time, one thread each, and wait for
+// all of them. A load that cannot get a thread runs on this one.
+void runConcurrently(LoadTask *tasks, int count) {
+#ifndef _WIN32
+    pthread_t threads[LOAD_MAX_THREADS];
+    int started[LOAD_MAX_THREADS];
+    for (int i = 0; i < count; i++) {
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, loadTaskWorker, &tasks[i]) == 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            tasks[i]();
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) tasks[i]();
+#endif
+}
+
+// Report orders that point at records the other files no longer have:
+// orders of users without an account, and cart items for products that
+// are no longer sold, which the user's next checkout drops
+void checkCrossReferences() {
+    int strayOrders = 0, strayCustomers = 0, staleItems = 0;
+    for (int i = 0; i < customerCount; i++) {
+        if (findUser(customers[i].username) == -1) {
+            strayOrders += customers[i].orders.count;
+            strayCustomers++;
+        }
+        for (int j = 0; j < customers[i].pending.count; j++) {
+            if (!isLiveProduct(orderAt(customers[i].pending.slots[j])->product)) staleItems++;
+        }
+    }
+    if (strayOrders > 0) {
+        printf("Note: %d orders belong to %d users without an account.\n", strayOrders, strayCustomers);
+    }
+    if (staleItems > 0) {
+        printf("Note: %d cart items are for products no longer sold and will be dropped at checkout.\n", staleItems);
+    }
+}
+
+// Load everything at startup: the binary snapshot if there is one, else the
+// text files, then the changes logged since. The text files and the history
+// index are independent, so each is loaded and indexed on its own thread
+// and startup takes about as long as the largest of them.
+void loadData() {
+    LoadTask loads[] = {loadOrders, loadProducts, loadUsers, loadLastSavedOrderId};
+    if (loadSnapshot()) {
+        loadLastSavedOrderId();
+    } else {
+        runConcurrently(loads, 4);
+        resolveOrders();
+        loadReviews();
+    }
+    replayChangeLog();
+    coverReservations();
+    checkCrossReferences();
+}
+
+// Point an empty pool at count records stored back to back. Full chunks are
+// used in place; the last partial chunk is copied so that it can take appends.
+void poolAttach(Pool *pool, char *records, int count) {
+    int full = count >> POOL_CHUNK_SHIFT;
+    for (int i = 0; i < full; i++) {
+        if (pool->chunkCount == pool->chunkCapacity) {
+            int newCapacity = pool->chunkCapacity ? pool->chunkCapacity * 2 : 16;
+            char **chunks = realloc(pool->chunks, newCapacity * sizeof(char *));
+            if (chunks == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            pool->chunks = chunks;
+            pool->chunkCapacity = newCapacity;
+        }
+        pool->chunks[pool->chunkCount++] = records + (size_t)i * POOL_CHUNK_SIZE * pool->recordSize;
+    }
+    int rest = count & (POOL_CHUNK_SIZE - 1);
+    if (rest > 0) {
+        char *chunk = poolReserve(pool, full << POOL_CHUNK_SHIFT);
+        memcpy(chunk, records + (size_t)full * POOL_CHUNK_SIZE * pool->recordSize, (size_t)rest * pool->recordSize);
+    }
+}
+
+// Copy a stored bucket array into a name index
+void loadNameIndex(NameIndex *index, char *data, long long size, int count) {
+    index->capacity = (int)(size / sizeof(IndexEntry));
+    index->count = count;
+    index->entries = malloc(size > 0 ? size : 1);
+    if (index->entries == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(index->entries, data, size);
+}
+
+// Map the binary snapshot and use it in place. Returns 0 if there is no
+// usable snapshot, in which case nothing has been loaded.
+int loadSnapshot() {
+    STAT_START();
+    char *data;
+    long long fileSize;
+#ifndef _WIN32
+    int fd = open(FILENAME_SNAPSHOT, O_RDONLY);
+    if (fd == -1) return 0;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    fileSize = info.st_size;
+    // A private mapping lets records be updated in place without touching
+    // the file; the mapping is never unmapped since records live in it
+    data = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+#else
+    FILE *file = fopen(FILENAME_SNAPSHOT, "rb");
+    if (file == NULL) return 0;
+    fseek(file, 0, SEEK_END);
+    fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(fileSize > 0 ? fileSize : 1);
+    if (data == NULL || fileSize < (long long)sizeof(SnapshotHeader) ||
+        fread(data, 1, fileSize, file) != (size_t)fileSize) {
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+#endif
+
+    SnapshotHeader *header = (SnapshotHeader *)data;
+    if (memcmp(header->magic, "ECOMSNAP", 8) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->userSize != sizeof(User) || header->productSize != sizeof(Product) ||
+        header->orderSize != sizeof(Order) || header->reviewSize != sizeof(Review) ||
+        header->offset[SECTION_COUNT - 1] + header->size[SECTION_COUNT - 1] > fileSize) {
+        printf("Snapshot %s is not compatible. Loading the text files instead.\n", FILENAME_SNAPSHOT);
+        return 0;
+    }
+
+    userCount = header->userCount;
+    productCount = header->productCount;
+    activeProductCount = header->activeProductCount;
+    orderCount = header->orderCount;
+    reviewCount = header->reviewCount;
+    lastOrderId = header->lastOrderId;
+    logGeneration = header->logGeneration;
+    poolAttach(&userPool, data + header->offset[SECTION_USERS], userCount);
+    poolAttach(&productPool, data + header->offset[SECTION_PRODUCTS], productCount);
+    poolAttach(&orderPool, data + header->offset[SECTION_ORDERS], orderCount);
+    poolAttach(&reviewPool, data + header->offset[SECTION_REVIEWS], reviewCount);
+
+    loadNameIndex(&userIndex, data + header->offset[SECTION_USER_INDEX],
+                  header->size[SECTION_USER_INDEX], header->userIndexCount);
+    if (userIndex.count < userCount) {
+        for (int i = 0; i < userCount; i++) {
+            if (findUser(userAt(i)->username) != i) slotListAppend(&duplicateUsers, i);
+        }
+    }
+    loadNameIndex(&productIndex, data + header->offset[SECTION_PRODUCT_INDEX],
+                  header->size[SECTION_PRODUCT_INDEX], header->productIndexCount);
+    priceIndex.count = header->priceIndexCount;
+    priceIndex.capacity = 0;
+    priceIndex.entries = (SortedEntry *)(data + header->offset[SECTION_PRICE_INDEX]);
+
+    // Categories and customers keep their lists in the mapping until they grow
+    categoryCount = categoryCapacity = header->categoryCount;
+    categories = malloc((categoryCount > 0 ? categoryCount : 1) * sizeof(Category));
+    SnapshotCategory *storedCategories = (SnapshotCategory *)(data + header->offset[SECTION_CATEGORIES]);
+    SortedEntry *categoryEntries = (SortedEntry *)(data + header->offset[SECTION_CATEGORY_ENTRIES]);
+    for (int i = 0; i < categoryCount; i++) {
+        strcpy(categories[i].name, storedCategories[i].name);
+        categories[i].products.entries = categoryEntries;
+        categories[i].products.count = storedCategories[i].count;
+        categories[i].products.capacity = 0;
+        categories[i].cheapest.count = 0;
+        categories[i].cheapest.stale = 1;
+        categoryEntries += storedCategories[i].count;
+    }
+    loadNameIndex(&categoryIndex, data + header->offset[SECTION_CATEGORY_INDEX],
+                  header->size[SECTION_CATEGORY_INDEX], categoryCount);
+
+    customerCount = customerCapacity = header->customerCount;
+    customers = malloc((customerCount > 0 ? customerCount : 1) * sizeof(CustomerOrders));
+    SnapshotCustomer *storedCustomers = (SnapshotCustomer *)(data + header->offset[SECTION_CUSTOMERS]);
+    int *customerSlots = (int *)(data + header->offset[SECTION_CUSTOMER_SLOTS]);
+    if (categories == NULL || customers == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < customerCount; i++) {
+        CustomerOrders *customer = &customers[i];
+        strcpy(customer->username, storedCustomers[i].username);
+        customer->orders.slots = customerSlots;
+        customer->orders.count = storedCustomers[i].orderCount;
+        customer->orders.capacity = 0;
+        customerSlots += storedCustomers[i].orderCount;
+        customer->pending.slots = customerSlots;
+        customer->pending.count = storedCustomers[i].pendingCount;
+        customer->pending.capacity = 0;
+        customerSlots += storedCustomers[i].pendingCount;
+    }
+    loadNameIndex(&customerIndex, data + header->offset[SECTION_CUSTOMER_INDEX],
+                  header->size[SECTION_CUSTOMER_INDEX], customerCount);
+
+    dictionaryCount = header->stringCount;
+    poolAttach(&dictionaryPool, data + header->offset[SECTION_STRINGS], dictionaryCount);
+    loadNameIndex(&dictionaryIndex, data + header->offset[SECTION_STRING_INDEX],
+                  header->size[SECTION_STRING_INDEX], dictionaryCount);
+
+    // The product columns are used in place until a new product is added
+    productColumns.price = (float *)(data + header->offset[SECTION_PRICE_COLUMN]);
+    productColumns.finalPrice = (float *)(data + header->offset[SECTION_FINAL_PRICE_COLUMN]);
+    productColumns.stock = (int *)(data + header->offset[SECTION_STOCK_COLUMN]);
+    productColumns.rating = (float *)(data + header->offset[SECTION_RATING_COLUMN]);
+    productColumns.category = (int *)(data + header->offset[SECTION_CATEGORY_COLUMN]);
+    productColumns.count = productCount;
+    productColumns.capacity = 0;
+    STAT_RECORD(STAT_LOAD_SNAPSHOT, fileSize);
+    return 1;
+}
+
+// Write size bytes at the next 64-byte boundary, recording where they went
+int writeSection(FILE *file, SnapshotHeader *header, int section, const void *data, long long size) {
+    static const char padding[64] = {0};
+    long long position = ftell(file);
+    long long aligned = (position + 63) & ~63LL;
+    if (aligned > position && fwrite(padding, 1, aligned - position, file) != (size_t)(aligned - position)) return 0;
+    header->offset[section] = aligned;
+    header->size[section] = size;
+    return size == 0 || fwrite(data, 1, size, file) == (size_t)size;
+}
+
+// Write a pool's records as one contiguous run
+int writePoolSection(FILE *file, SnapshotHeader *header, int section, Pool *pool, int count) {
+    int ok = writeSection(file, header, section, NULL, 0);
+    for (int i = 0; ok && i < count; i += POOL_CHUNK_SIZE) {
+        int records = count - i < POOL_CHUNK_SIZE ? count - i : POOL_CHUNK_SIZE;
+        size_t bytes = (size_t)records * pool->recordSize;
+        ok = fwrite(pool->chunks[i >> POOL_CHUNK_SHIFT], 1, bytes, file) == bytes;
+    }
+    header->size[section] = (long long)count * pool->recordSize;
+    return ok;
+}
+
+// Write the binary snapshot to a temporary file and rename it into place,
+// so the snapshot that is currently mapped is never modified and a crash
+// leaves either the old snapshot or the new one. Returns 1 on success.
+int saveSnapshot() {
+    STAT_START();
+    // Stored indexes never list deleted products
+    if (tombstoneCount > 0) {
+        compactSearchIndexes();
+    }
+
+    FILE *file = openReplacement(FILENAME_SNAPSHOT, "wb");
+    if (file == NULL) {
+        printf("Error saving snapshot.\n");
+        return 0;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ECOMSNAP", 8);
+    header.version = SNAPSHOT_VERSION;
+    header.userSize = sizeof(User);
+    header.productSize = sizeof(Product);
+    header.orderSize = sizeof(Order);
+    header.reviewSize = sizeof(Review);
+    header.userCount = userCount;
+    header.productCount = productCount;
+    header.activeProductCount = activeProductCount;
+    header.orderCount = orderCount;
+    header.reviewCount = reviewCount;
+    header.categoryCount = categoryCount;
+    header.customerCount = customerCount;
+    header.userIndexCount = userIndex.count;
+    header.productIndexCount = productIndex.count;
+    header.priceIndexCount = priceIndex.count;
+    header.stringCount = dictionaryCount;
+    header.lastOrderId = lastOrderId;
+    header.logGeneration = logGeneration;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && writePoolSection(file, &header, SECTION_USERS, &userPool, userCount);
+    ok = ok && writeSection(file, &header, SECTION_USER_INDEX, userIndex.entries,
+                            (long long)userIndex.capacity * sizeof(IndexEntry));
+    ok = ok && writePoolSection(file, &header, SECTION_PRODUCTS, &productPool, productCount);
+    ok = ok && writePoolSection(file, &header, SECTION_ORDERS, &orderPool, orderCount);
+    ok = ok && writePoolSection(file, &header, SECTION_REVIEWS, &reviewPool, reviewCount);
+    ok = ok && writeSection(file, &header, SECTION_PRODUCT_INDEX, productIndex.entries,
+                            (long long)productIndex.capacity * sizeof(IndexEntry));
+    ok = ok && writeSection(file, &header, SECTION_PRICE_INDEX, priceIndex.entries,
+                            (long long)priceIndex.count * sizeof(SortedEntry));
+
+    ok = ok && writeSection(file, &header, SECTION_CATEGORIES, NULL, 0);
+    for (int i = 0; ok && i < categoryCount; i++) {
+        SnapshotCategory stored;
+        memset(&stored, 0, sizeof(stored));
+        strcpy(stored.name, categories[i].name);
+        stored.count = categories[i].products.count;
+        ok = fwrite(&stored, sizeof(stored), 1, file) == 1;
+    }
+    header.size[SECTION_CATEGORIES] = (long long)categoryCount * sizeof(SnapshotCategory);
+    ok = ok && writeSection(file, &header, SECTION_CATEGORY_INDEX, categoryIndex.entries,
+                            (long long)categoryIndex.capacity * sizeof(IndexEntry));
+    ok = ok && writeSection(file, &header, SECTION_CATEGORY_ENTRIES, NULL, 0);
+    long long entryBytes = 0;
+    for (int i = 0; ok && i < categoryCount; i++) {
+        SortedIndex *list = &categories[i].products;
+        ok = list->count == 0 || fwrite(list->entries, sizeof(SortedEntry), list->count, file) == (size_t)list->count;
+        entryBytes += (long long)list->count * sizeof(SortedEntry);
+    }
+    header.size[SECTION_CATEGORY_ENTRIES] = entryBytes;
+
+    ok = ok && writeSection(file, &header, SECTION_CUSTOMERS, NULL, 0);
+    for (int i = 0; ok && i < customerCount; i++) {
+        SnapshotCustomer stored;
+        memset(&stored, 0, sizeof(stored));
+        strcpy(stored.username, customers[i].username);
+        stored.orderCount = customers[i].orders.count;
+        stored.pendingCount = customers[i].pending.count;
+        ok = fwrite(&stored, sizeof(stored), 1, file) == 1;
+    }
+    header.size[SECTION_CUSTOMERS] = (long long)customerCount * sizeof(SnapshotCustomer);
+    ok = ok && writeSection(file, &header, SECTION_CUSTOMER_INDEX, customerIndex.entries,
+                            (long long)customerIndex.capacity * sizeof(IndexEntry));
+    ok = ok && writeSection(file, &header, SECTION_CUSTOMER_SLOTS, NULL, 0);
+    long long slotBytes = 0;
+    for (int i = 0; ok && i < customerCount; i++) {
+        SlotList *orders = &customers[i].orders, *pending = &customers[i].pending;
+        ok = (orders->count == 0 || fwrite(orders->slots, sizeof(int), orders->count, file) == (size_t)orders->count) &&
+             (pending->count == 0 || fwrite(pending->slots, sizeof(int), pending->count, file) == (size_t)pending->count);
+        slotBytes += (long long)(orders->count + pending->count) * sizeof(int);
+    }
+    header.size[SECTION_CUSTOMER_SLOTS] = slotBytes;
+
+    long long columnBytes = (long long)productCount * 4;
+    ok = ok && writeSection(file, &header, SECTION_PRICE_COLUMN, productColumns.price, columnBytes);
+    ok = ok && writeSection(file, &header, SECTION_FINAL_PRICE_COLUMN, productColumns.finalPrice, columnBytes);
+    ok = ok && writeSection(file, &header, SECTION_STOCK_COLUMN, productColumns.stock, columnBytes);
+    ok = ok && writeSection(file, &header, SECTION_RATING_COLUMN, productColumns.rating, columnBytes);
+    ok = ok && writeSection(file, &header, SECTION_CATEGORY_COLUMN, productColumns.category, columnBytes);
+    ok = ok && writePoolSection(file, &header, SECTION_STRINGS, &dictionaryPool, dictionaryCount);
+    ok = ok && writeSection(file, &header, SECTION_STRING_INDEX, dictionaryIndex.entries,
+                            (long long)dictionaryIndex.capacity * sizeof(IndexEntry));
+
+    // Now that every section's place is known, fill in the header
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if (!replaceFile(file, FILENAME_SNAPSHOT, ok)) {
+        printf("Error saving snapshot.\n");
+        return 0;
+    }
+    STAT_RECORD(STAT_SAVE_SNAPSHOT, header.offset[SECTION_COUNT - 1] + header.size[SECTION_COUNT - 1]);
+    return 1;
+}
+
+// Rebuild the snapshot from the text files, dropping any logged changes
+void importTextFiles() {
+    loadUsers();
+    loadProducts();
+    loadOrders();
+    resolveOrders();
+    loadReviews();
+    if (!saveSnapshot()) return;
+    remove(FILENAME_CHANGE_LOG);
+    printf("Imported %d users, %d products and %d orders.\n", userCount, activeProductCount, orderCount);
+}
+
+// Write the current data back out as text files
+void exportTextFiles() {
+    saveUsers();
+    saveProducts();
+    saveOrders();
+    saveReviews();
+    printf("Exported %d users, %d products and %d orders.\n", userCount, activeProductCount, orderCount);
+}
+
+// Check that slot holds a product that has not been deleted
+int isLiveProduct(int slot) {
+    return slot >= 0 && slot < productCount && !productAt(slot)->deleted;
+}
+
+// Store a new regular user
+int createUser(const char *username, const char *password) {
+    if (findUser(username) != -1) {
+        return RESULT_EXISTS;
+    }
+
+    User newUser;
+    memset(&newUser, 0, sizeof(newUser));
+    strncpy(newUser.username, username, 49);
+    strncpy(newUser.password, password, PASSWORD_LENGTH - 1);
+    newUser.isAdmin = 0;
+
+    appendUser(&newUser);
+    logChange("user %s %s %d\n", newUser.username, newUser.password, newUser.isAdmin);
+    return RESULT_OK;
+}
+
+// Check credentials: 1 for the admin, 0 for a regular user, -1 otherwise
+int authenticateUser(const char *username, const char *password) {
+    STAT_START();
+    int result = -1;
+
+    // Check for fixed admin credentials
+    if (strcmp(username, "admin") == 0 && strcmp(password, "MATRF") == 0) {
+        result = 1;
+    }
+
+    // Check for regular users. A name listed twice in users.txt may log
+    // in with either password.
+    if (result == -1) {
+        int slot = findUser(username);
+        if (slot != -1 && strcmp(userAt(slot)->password, password) == 0) {
+            result = 0;
+        }
+        for (int i = 0; slot != -1 && result == -1 && i < duplicateUsers.count; i++) {
+            User *user = userAt(duplicateUsers.slots[i]);
+            if (strcmp(user->username, username) == 0 && strcmp(user->password, password) == 0) {
+                result = 0;
+            }
+        }
+    }
+    STAT_RECORD(STAT_LOGIN, 0);
+    return result;
+}
+
+// Add a product to the catalog, returning its slot
+int createProduct(const char *name, const char *category, float price, int stock, float discount, int *slot) {
+    if (strlen(name) > 49 || strlen(category) > 49 ||
+        price < 0.01 || price > 1000000.0 || stock < 1 || stock > 1000000 ||
+        discount < 0.0 || discount > 100.0) {
+        return RESULT_INVALID;
+    }
+    if (findProduct(name) != -1) {
+        return RESULT_EXISTS;
+    }
+
+    Product newProduct;
+    memset(&newProduct, 0, sizeof(newProduct));
+    strcpy(newProduct.name, name);
+    newProduct.category = categoryId(category);
+    newProduct.price = price;
+    newProduct.stock = stock;
+    newProduct.discount = discount;
+    newProduct.latestReview = -1;
+    newProduct.deleted = 0;
+
+    *slot = productCount;
+    appendProduct(&newProduct);
+    logChange("product %s %s %.2f %d %.2f\n",
+              newProduct.name,
+              category,
+              newProduct.price,
+              newProduct.stock,
+              newProduct.discount);
+    return RESULT_OK;
+}
+
+// Delete the product in slot
+int removeProductAt(int slot) {
+    if (!isLiveProduct(slot)) return RESULT_NOT_FOUND;
+    logChange("remove %s\n", productAt(slot)->name);
+    deleteProductAt(slot);
+    return RESULT_OK;
+}
+
+// Change the discount of the product in slot
+int setProductDiscount(int slot, float discount) {
+    if (!isLiveProduct(slot)) return RESULT_NOT_FOUND;
+    if (discount < 0.0 || discount > 100.0) return RESULT_INVALID;
+    productAt(slot)->discount = discount;
+    syncProductColumns(slot);
+    logChange("discount %s %.2f\n", productAt(slot)->name, discount);
+    return RESULT_OK;
+}
+
+// Put quantity of the product in slot into a user's cart as a pending order
+int placeInCart(const char *username, int slot, int quantity, const char *address, int *orderId) {
+    if (!isLiveProduct(slot)) return RESULT_NOT_FOUND;
+    if (quantity < 1) return RESULT_INVALID;
+    STAT_START();
+    Product *product = productAt(slot);
+    if (!reserveStock(slot, quantity)) {
+        STAT_RECORD(STAT_ADD_TO_CART, 0);
+        return RESULT_NO_STOCK;
+    }
+
+    lockOrders();
+    Order newOrder;
+    memset(&newOrder, 0, sizeof(newOrder));
+    newOrder.orderId = ++lastOrderId; // Assign a new order ID
+    newOrder.customer = (int)(findCustomerOrders(username, 1) - customers);
+    newOrder.product = slot;
+    newOrder.quantity = quantity;
+    newOrder.totalPrice = product->price * quantity * (1 - product->discount / 100);
+    newOrder.address = internString(address);
+    newOrder.paymentMethod = -1;
+    newOrder.status = ORDER_PENDING;
+
+    appendOrder(&newOrder);
+    Reservation *reservation = reservationAt(orderCount - 1);
+    reservation->product = slot;
+    reservation->quantity = quantity;
+    reservation->expires = time(NULL) + RESERVATION_SECONDS;
+    slotListAppend(&reservedOrders, orderCount - 1);
+    logChange("order %d %s %s %d %.2f %s\n",
+              newOrder.orderId,
+              customers[newOrder.customer].username,
+              product->name,
+              newOrder.quantity,
+              newOrder.totalPrice,
+              stringAt(newOrder.address));
+    *orderId = newOrder.orderId;
+    unlockOrders();
+    STAT_RECORD(STAT_ADD_TO_CART, 0);
+    return RESULT_OK;
+}
+
+// Pay for a user's whole cart and record it in the order history
+int checkoutCart(const char *username, const char *paymentMethod, int *items, float *total) {
+    CustomerOrders *customer = findCustomerOrders(username, 0);
+    *items = 0;
+    *total = 0;
+    if (customer != NULL) dropStaleCartItems(customer, 0);
+    if (customer == NULL || customer->pending.count == 0) return RESULT_EMPTY;
+
+    for (int i = 0; i < customer->pending.count; i++) {
+        *total += orderAt(customer->pending.slots[i])->totalPrice;
+    }
+    *items = customer->pending.count;
+    STAT_START();
+    int committed = commitCheckout(customer, paymentMethod);
+    if (committed) saveOrderHistory();
+    STAT_RECORD(STAT_CHECKOUT, 0);
+    return committed ? RESULT_OK : RESULT_NO_STOCK;
+}
+
+// Find one of a user's orders by ID, returning its index or -1
+int findUserOrder(const char *username, int orderId) {
+    CustomerOrders *customer = findCustomerOrders(username, 0);
+    for (int i = 0; customer != NULL && i < customer->orders.count; i++) {
+        if (orderAt(customer->orders.slots[i])->orderId == orderId) {
+            return customer->orders.slots[i];
+        }
+    }
+    return -1;
+}
+
+// Append a review to the product in slot and fold its rating into the
+// product's count, sum and mean. Returns the review's slot.
+int addReview(int slot, float rating, const char *text) {
+    Product *product = productAt(slot);
+    Review *review = poolReserve(&reviewPool, reviewCount);
+    review->product = slot;
+    review->previous = product->latestReview;
+    review->rating = rating;
+    strncpy(review->text, text, 99);
+    review->text[99] = '\0';
+
+    product->latestReview = reviewCount;
+    product->reviewCount++;
+    product->ratingSum += rating;
+    product->rating = (float)(product->ratingSum / product->reviewCount);
+    syncProductColumns(slot);
+    if (textIndexReady) indexText(slot, FIELD_REVIEW, review->text);
+    return reviewCount++;
+}
+
+// Text of the product's newest review, as shown in product listings
+const char *latestReviewText(int slot) {
+    int latest = productAt(slot)->latestReview;
+    return latest != -1 ? reviewAt(latest)->text : "No reviews yet.";
+}
+
+// Fill page with up to limit of the product's review slots, newest first,
+// starting after the review in slot before (-1 for the newest). The last
+// slot returned is the cursor for the next page.
+int pageReviews(int slot, int before, int limit, int *page) {
+    int review = before == -1 ? productAt(slot)->latestReview : reviewAt(before)->previous;
+    int count = 0;
+    for (; review != -1 && count < limit; review = reviewAt(review)->previous) {
+        page[count++] = review;
+    }
+    return count;
+}
+
+// Record a rating and review for the product in slot
+int reviewProduct(int slot, float rating, const char *text) {
+    if (!isLiveProduct(slot)) return RESULT_NOT_FOUND;
+    if (rating < 0.0 || rating > 5.0) return RESULT_INVALID;
+    STAT_START();
+    // Review text is the last field of its line in the data files, so it
+    // needs at least one visible character to be read back
+    if (text[strspn(text, " \t\r\n\v\f")] == '\0') text = "No comment.";
+    int review = addReview(slot, rating, text);
+    logChange("review %s %.2f %s\n", productAt(slot)->name, rating, reviewAt(review)->text);
+    STAT_RECORD(STAT_REVIEW, 0);
+    return RESULT_OK;
+}
+
+// Register a new user
+void registerUser() {
+    char username[50], password[PASSWORD_LENGTH];
+    printf("Enter username (max 49 chars): ");
+    scanf("%49s", username);
+
+    // Check if username already exists
+    if (findUser(username) != -1) {
+        printf("Username already exists.\n");
+        return;
+    }
+
+    printf("Enter password (max %d chars): ", PASSWORD_LENGTH-1);
+    scanf("%49s", password);
+
+    if (createUser(username, password) == RESULT_OK) {
+        printf("User registered successfully!\n");
+    } else {
+        printf("Username already exists.\n");
+    }
+}
+
+// Login a user
+int loginUser(char *username) {
+    char password[PASSWORD_LENGTH];
+    printf("Enter username: ");
+    scanf("%49s", username);
+    printf("Enter password: ");
+    scanf("%49s", password);
+
+    int result = authenticateUser(username, password);
+    if (result == 1) {
+        printf("Admin login successful!\n");
+    } else if (result == 0) {
+        printf("Login successful!\n");
+    } else {
+        printf("Invalid username or password.\n");
+    }
+    return result;
+}
+
+// Admin panel
+void adminPanel() {
+    int choice;
+    do {
+        printf("\nAdmin Panel\n");
         printf("1. Add Product\n");
         printf("2. Remove Product\n");
         printf("3. Update Discount\n");
         printf("4. View Order History\n");
         printf("5. View Products\n");
-        printf("6. Logout\n");
+        printf("6. View Statistics\n");
+        printf("7. Top Products\n");
+        printf("8. Logout\n");
+        printf("Enter your choice: ");
+        choice = getIntegerInput("", 1, 8);
+
+        switch (choice) {
+            case 1:
+                addProduct();
+                break;
+            case 2:
+                removeProduct();
+                break;
+            case 3:
+                updateDiscount();
+                break;
+            case 4:
+                viewOrderHistory();
+                break;
+            case 5:
+                displayProducts();
+                break;
+            case 6:
+                showStats();
+                break;
+            case 7:
+                viewTopProducts();
+                break;
+            case 8:
+                printf("Logged out.\n");
+                break;
+        }
+    } while (choice != 8);
+}
+
+// User panel
+void userPanel(char *username) {
+    int choice;
+    do {
+        printf("\nUser Panel - Welcome %s\n", username);
+        printf("1. View Products\n");
+        printf("2. Search Products\n");
+        printf("3. Add to Cart\n");
+        printf("4. View My Orders\n");
+        printf("5. Checkout\n");
+        printf("6. Review Products\n");
+        printf("7. Read Reviews\n");
+        printf("8. Top Products\n");
+        printf("9. Logout\n");
         printf("Enter your choice: ");
-        choice = getIntegerInput("", 1, 6);
+        choice = getIntegerInput("", 1, 9);
+
+        switch (choice) {
+            case 1:
+                displayProducts();
+                break;
+            case 2:
+                searchProducts();
+                break;
+            case 3:
+                addToCart(username);
+                break;
+            case 4:
+                displayUserOrders(username);
+                break;
+            case 5:
+                checkout(username);
+                break;
+            case 6:
+                provideRatingAndReview(username);
+                break;
+            case 7:
+                viewProductReviews();
+                break;
+            case 8:
+                viewTopProducts();
+                break;
+            case 9:
+                printf("Logged out.\n");
+                break;
+        }
+    } while (choice != 9);
+}
+
+// Display orders for a specific user
+void displayUserOrders(char *username) {
+    printf("\nYour Orders:\n");
+    CustomerOrders *customer = findCustomerOrders(username, 0);
+    if (customer == NULL || customer->orders.count == 0) {
+        printf("You have no orders yet.\n");
+        return;
+    }
+
+    int shown = 0;
+    do {
+        for (int end = shown + PAGE_SIZE; shown < end && shown < customer->orders.count; shown++) {
+            renderOrder(&screen, orderAt(customer->orders.slots[shown]));
+        }
+        flushScreen();
+    } while (askNextPage(shown, customer->orders.count));
+}
+
+// Add a new product (admin only)
+void addProduct() {
+    char name[50], category[50];
+    printf("Enter product name (max 49 chars): ");
+    scanf("%49s", name);
+    if (findProduct(name) != -1) {
+        printf("A product with this name already exists.\n");
+        return;
+    }
+    printf("Enter product category (max 49 chars): ");
+    scanf("%49s", category);
+    float price = getFloatInput("Enter product price: ", 0.01, 1000000.0);
+    int stock = getIntegerInput("Enter product stock: ", 1, 1000000);
+    float discount = getFloatInput("Enter product discount (%): ", 0.0, 100.0);
+
+    int slot;
+    if (createProduct(name, category, price, stock, discount, &slot) == RESULT_OK) {
+        printf("Product added successfully!\n");
+    } else {
+        printf("A product with this name already exists.\n");
+    }
+}
+
+// Remove a product (admin only)
+void removeProduct() {
+    if (activeProductCount == 0) {
+        printf("No products available to delete.\n");
+        return;
+    }
+
+    displayProducts();
+    int serial = getProductSerial("Enter the serial number of the product to delete (0 to cancel): ", 0);
+
+    if (serial == 0) {
+        printf("Product deletion cancelled.\n");
+        return;
+    }
+
+    removeProductAt(serial - 1);
+    printf("Product deleted successfully.\n");
+}
+
+// Update discount for a product (admin only)
+void updateDiscount() {
+    if (activeProductCount == 0) {
+        printf("No products available to update.\n");
+        return;
+    }
+
+    displayProducts();
+    int serial = getProductSerial("Enter the serial number of the product to update discount: ", 1);
+    float discount = getFloatInput("Enter new discount (%): ", 0.0, 100.0);
+
+    setProductDiscount(serial - 1, discount);
+    printf("Discount updated successfully!\n");
+}
+
+// View order history (admin only)
+void viewOrderHistory() {
+    FILE *index = fopen(FILENAME_HISTORY_INDEX, "rb");
+    int count = index != NULL ? historyEntryCount(index) : 0;
+    if (count == 0) {
+        printf("No order history found.\n");
+        if (index != NULL) fclose(index);
+        return;
+    }
+
+    int choice = getIntegerInput("View:\n1. Most Recent Orders\n2. Find by Order ID\n3. Date Range\n4. Sales Report\nEnter your choice: ", 1, 4);
+    HistoryIndexEntry entry;
+
+    if (choice == 1) {
+        int recent = getIntegerInput("How many orders: ", 1, count);
+        printf("\nOrder History:\n");
+        printHistoryEntries(index, count - recent, count - 1);
+
+    } else if (choice == 2) {
+        int orderId = getIntegerInput("Enter Order ID: ", 1, 2147483647);
+        int low = 0, high = count - 1, found = -1;
+        while (low <= high) {
+            int mid = low + (high - low) / 2;
+            if (!readHistoryEntry(index, mid, &entry)) break;
+            if (entry.orderId == orderId) {
+                found = mid;
+                break;
+            }
+            if (entry.orderId < orderId) low = mid + 1;
+            else high = mid - 1;
+        }
+        printf("\nOrder History:\n");
+        if (found == -1) printf("Order ID not found in history.\n");
+        else printHistoryEntries(index, found, found);
+
+    } else if (choice == 4) {
+        SalesReport report;
+        if (analyzeHistory(0, &report)) {
+            formatSalesReport(&screen, &report);
+            flushScreen();
+        }
+        freeSalesReport(&report);
+
+    } else {
+        char from[11], to[11];
+        struct tm date;
+        time_t range[2];
+        printf("Enter start date (YYYY-MM-DD): ");
+        scanf("%10s", from);
+        printf("Enter end date (YYYY-MM-DD): ");
+        scanf("%10s", to);
+        for (int i = 0; i < 2; i++) {
+            memset(&date, 0, sizeof(date));
+            if (sscanf(i == 0 ? from : to, "%d-%d-%d", &date.tm_year, &date.tm_mon, &date.tm_mday) != 3) {
+                printf("Invalid date.\n");
+                fclose(index);
+                return;
+            }
+            date.tm_year -= 1900;
+            date.tm_mon -= 1;
+            date.tm_isdst = -1;
+            if (i == 1) {
+                date.tm_hour = 23;
+                date.tm_min = 59;
+                date.tm_sec = 59;
+            }
+            range[i] = mktime(&date);
+        }
+
+        // First entry written at or after the start of the range
+        int low = 0, high = count;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (readHistoryEntry(index, mid, &entry) && entry.timestamp < range[0]) low = mid + 1;
+            else high = mid;
+        }
+        int first = low;
+        high = count;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (readHistoryEntry(index, mid, &entry) && entry.timestamp <= range[1]) low = mid + 1;
+            else high = mid;
+        }
+        printf("\nOrder History:\n");
+        if (low == first) printf("No orders found in this date range.\n");
+        else printHistoryEntries(index, first, low - 1);
+    }
+    fclose(index);
+}
+
+// Print the history lines for index entries first..last
+void printHistoryEntries(FILE *index, int first, int last) {
+    FILE *history = fopen(FILENAME_ORDER_HISTORY, "rb");
+    if (history == NULL) {
+        printf("No order history found.\n");
+        return;
+    }
+    HistoryIndexEntry entry;
+    char line[500];
+    for (int i = first; i <= last && readHistoryEntry(index, i, &entry); i++) {
+        int length = entry.length < (int)sizeof(line) ? entry.length : (int)sizeof(line) - 1;
+        fseek(history, entry.offset, SEEK_SET);
+        line[fread(line, 1, length, history)] = '\0';
+        printf("%s", line);
+        if (length < entry.length) printf("\n"); // Cut short, newline and all
+    }
+    fclose(history);
+}
+
+// Display all products
+void displayProducts() {
+    if (activeProductCount == 0) {
+        printf("No products available.\n");
+        return;
+    }
+
+    // The cursor is the next slot to look at, so each page costs
+    // O(page) however far into the catalog it is
+    printf("\nProduct List:\n");
+    int cursor = 0, shown = 0;
+    do {
+        for (int rendered = 0; rendered < PAGE_SIZE && cursor < productCount; cursor++) {
+            if (productAt(cursor)->deleted) continue;
+            renderProduct(&screen, cursor, 1);
+            rendered++;
+            shown++;
+        }
+        flushScreen();
+    } while (askNextPage(shown, activeProductCount));
+}
+
+// Print search results in the product listing format
+void printSearchResults(int *results, int count, int showCategory) {
+    int shown = 0;
+    do {
+        for (int end = shown + PAGE_SIZE; shown < end && shown < count; shown++) {
+            renderProduct(&screen, results[shown], showCategory);
+        }
+        flushScreen();
+    } while (askNextPage(shown, count));
+}
+
+// Format one product in the listing format
+void renderProduct(Buffer *out, int slot, int showCategory) {
+    Product *product = productAt(slot);
+    if (showCategory) {
+        bufferPrintf(out, "Serial: %d\nName: %s\nCategory: %s\n", slot + 1, product->name, categories[product->category].name);
+    } else {
+        bufferPrintf(out, "Serial: %d\nName: %s\n", slot + 1, product->name);
+    }
+    bufferPrintf(out, "Price: %.2f\nDiscount: %.2f%%\nStock: %d\nRating: %.2f (%d reviews)\nLatest review: %s\n------------------------\n",
+                 product->price,
+                 product->discount,
+                 product->stock,
+                 product->rating,
+                 product->reviewCount,
+                 latestReviewText(slot));
+}
+
+// Format one order in the listing format
+void renderOrder(Buffer *out, Order *order) {
+    bufferPrintf(out, "Order ID: %d\nProduct: %s\nQuantity: %d\nTotal Price: %.2f\nPayment Method: %s\nDelivery Address: %s\n------------------------\n",
+                 order->orderId,
+                 productAt(order->product)->name,
+                 order->quantity,
+                 order->totalPrice,
+                 orderMethod(order),
+                 stringAt(order->address));
+}
+
+// Write everything formatted into the screen buffer in one call
+void flushScreen() {
+    fwrite(screen.data, 1, screen.length, stdout);
+    fflush(stdout);
+    screen.length = 0;
+}
+
+// After a page of a listing, ask whether to show the next one
+int askNextPage(int shown, int total) {
+    if (shown >= total) return 0;
+    printf("Showing %d of %d.\n", shown, total);
+    return getIntegerInput("Enter 1 for the next page or 0 to stop: ", 0, 1);
+}
+
+// Search products by category, price range, deal or keywords
+void searchProducts() {
+    int choice = getIntegerInput("Search by:\n1. Category\n2. Price Range\n3. Both\n4. Deals (price after discount and rating)\n5. Keywords (name, category or reviews)\nEnter your choice: ", 1, 5);
+    int *results;
+    int count;
+
+    if (choice == 1) {
+        char category[50];
+        printf("Enter category to search: ");
+        scanf("%49s", category);
+        printf("\nProducts in category '%s':\n", category);
+
+        count = findMatchingProducts(category, 0, 0, 0, &results);
+        printSearchResults(results, count, 0);
+        if (count == 0) printf("No products found in this category.\n");
+
+    } else if (choice == 2) {
+        float minPrice = getFloatInput("Enter minimum price: ", 0.0, 1000000.0);
+        float maxPrice = getFloatInput("Enter maximum price: ", minPrice, 1000000.0);
+        printf("\nProducts between %.2f and %.2f:\n", minPrice, maxPrice);
+
+        count = findMatchingProducts(NULL, 1, minPrice, maxPrice, &results);
+        printSearchResults(results, count, 1);
+        if (count == 0) printf("No products found in this price range.\n");
+
+    } else if (choice == 3) {
+        char category[50];
+        printf("Enter category to search: ");
+        scanf("%49s", category);
+        float minPrice = getFloatInput("Enter minimum price: ", 0.0, 1000000.0);
+        float maxPrice = getFloatInput("Enter maximum price: ", minPrice, 1000000.0);
+        printf("\nProducts in category '%s' and between %.2f and %.2f:\n", category, minPrice, maxPrice);
+
+        count = findMatchingProducts(category, 1, minPrice, maxPrice, &results);
+        printSearchResults(results, count, 0);
+        if (count == 0) printf("No products found matching these criteria.\n");
+
+    } else if (choice == 4) {
+        ProductFilter filter = {-1, 1, 0, 0, 0, 1};
+        filter.minPrice = getFloatInput("Enter minimum price after discount: ", 0.0, 1000000.0);
+        filter.maxPrice = getFloatInput("Enter maximum price after discount: ", filter.minPrice, 1000000.0);
+        filter.minRating = getFloatInput("Enter minimum rating (0-5): ", 0.0, 5.0);
+        printf("\nIn-stock products between %.2f and %.2f after discount, rated %.2f or more:\n",
+               filter.minPrice, filter.maxPrice, filter.minRating);
+
+        count = filterProducts(&filter, &results);
+        printSearchResults(results, count, 1);
+        if (count == 0) printf("No products found matching these criteria.\n");
+
+    } else {
+        char query[200];
+        printf("Enter words to search for: ");
+        scanf(" %199[^\n]", query);
+        results = malloc(TEXT_RESULTS_MAX * sizeof(int));
+        if (results == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("\nBest matches for '%s':\n", query);
+
+        count = searchText(query, TEXT_RESULTS_MAX, results);
+        printSearchResults(results, count, 1);
+        if (count == 0) printf("No products match these words.\n");
+    }
+    free(results);
+}
+
+// Add product to cart
+void addToCart(char *username) {
+    displayProducts();
+    if (activeProductCount == 0) return;
+
+    int serial = getProductSerial("Enter the serial number of the product to add to cart (0 to cancel): ", 0);
+    if (serial == 0) return;
+
+    if (availableStock(serial - 1) < 1) {
+        printf("Insufficient stock.\n");
+        return;
+    }
+    int quantity = getIntegerInput("Enter quantity: ", 1, availableStock(serial - 1));
+
+    if (availableStock(serial - 1) >= quantity) {
+        char address[100];
+        printf("Enter your address: ");
+        getchar(); // Clear buffer
+        fgets(address, 100, stdin);
+        address[strcspn(address, "\n")] = 0;
+
+        int orderId;
+        if (placeInCart(username, serial - 1, quantity, address, &orderId) == RESULT_OK) {
+            printf("Product added to cart successfully! Order ID: %d\n", orderId);
+        } else {
+            printf("Insufficient stock.\n");
+        }
+    } else {
+        printf("Insufficient stock.\n");
+    }
+}
+
+// Checkout and place order
+void checkout(char *username) {
+    float total = 0;
+    printf("\nYour Cart:\n");
+
+    CustomerOrders *customer = findCustomerOrders(username, 0);
+    if (customer != NULL) {
+        dropStaleCartItems(customer, 1);
+        for (int i = 0; i < customer->pending.count; i++) {
+            Order *order = orderAt(customer->pending.slots[i]);
+            printf("Order ID: %d\n", order->orderId);
+            printf("Product: %s, Quantity: %d, Total Price: %.2f\n",
+                   productAt(order->product)->name,
+                   order->quantity,
+                   order->totalPrice);
+            total += order->totalPrice;
+        }
+    }
+
+    if (customer == NULL || customer->pending.count == 0) {
+        printf("Your cart is empty. No payment required.\n");
+        getchar(); // Wait for user input
+        return;
+    }
+
+    printf("Total Amount: %.2f\n", total);
+
+    // Make sure the whole cart can be filled before taking any payment
+    CartLine *lines;
+    if (collectCartLines(customer, &lines, 1) < 0) {
+        return;
+    }
+    free(lines);
+
+    // Payment method selection
+    printf("Choose payment method:\n");
+    printf("1. Visa/Mastercard\n");
+    printf("2. Mobile Banking (Bkash/Nagad)\n");
+    printf("3. Cash on Delivery\n");
+    printf("4. Back to Main Menu\n");
+    int paymentChoice = getIntegerInput("Enter your choice: ", 1, 4);
+
+    if (paymentChoice == 4) {
+        printf("Returning to the main menu...\n");
+        return;
+    }
+
+    // Process payment
+    const char *paymentMethod = "Cash on Delivery";
+    switch (paymentChoice) {
+        case 1: {
+            char accountNumber[20], pin[10];
+            printf("Enter your account number: ");
+            scanf("%19s", accountNumber);
+            printf("Enter your PIN: ");
+            scanf("%9s", pin);
+            printf("Processing payment...\n");
+            printf("Payment Succeed!\n");
+            printf("Your %.2f Taka Paid\n", total);
+
+            paymentMethod = "Visa/Mastercard";
+            break;
+        }
+        case 2: {
+            int mobileChoice = getIntegerInput("Choose:\n1. Bkash\n2. Nagad\nEnter choice: ", 1, 2);
+            char mobileNumber[15], pin[10];
+            do {
+                printf("Enter your mobile number (11 digits): ");
+                scanf("%14s", mobileNumber);
+            } while (!validateMobileNumber(mobileNumber));
+            printf("Enter your PIN: ");
+            scanf("%9s", pin);
+            printf("Processing payment...\n");
+            printf("Payment Succeed!\n");
+            printf("Your %.2f Taka Paid\n", total);
+
+            paymentMethod = (mobileChoice == 1) ? "Bkash" : "Nagad";
+            break;
+        }
+        case 3: {
+            printf("You have chosen Cash on Delivery. Payment will be made upon delivery.\n");
+            break;
+        }
+    }
+
+    // Update payment method and stock for all pending orders at once, then
+    // save to order history
+    int items;
+    if (checkoutCart(username, paymentMethod, &items, &total) != RESULT_OK) {
+        printf("Checkout failed. Your cart has not been changed.\n");
+        return;
+    }
+    printf("Thank you for your purchase!\n");
+}
+
+// Update stock for a single product. Checkout commits the whole cart with
+// commitCheckout; this per-item path is kept for the checkout benchmark.
+void updateStock(char *productName, int quantity) {
+    int i = findProduct(productName);
+    if (i == -1) return;
+
+    productAt(i)->stock -= quantity;
+    syncProductColumns(i);
+    if (productAt(i)->stock <= 0) {
+        // Auto delete out-of-stock products
+        logChange("remove %s\n", productName);
+        deleteProductAt(i);
+    } else {
+        logChange("stock %s %d\n", productName, productAt(i)->stock);
+    }
+}
+
+// Provide rating and review after checkout
+void provideRatingAndReview(char *username) {
+    displayUserOrders(username);
+    if (orderCount == 0) return;
+
+    int orderId = getIntegerInput("Enter the Order ID you want to review (0 to cancel): ", 0, lastOrderId);
+    if (orderId == 0) return;
+
+    // Find the product in the order
+    int order = findUserOrder(username, orderId);
+    if (order == -1) {
+        printf("Order ID not found or doesn't belong to you.\n");
+        return;
+    }
+
+    // Check the product is still sold
+    int i = orderAt(order)->product;
+    if (!isLiveProduct(i)) {
+        printf("Product not found.\n");
+        return;
+    }
+
+    char review[100];
+    float rating = getFloatInput("Enter your rating (0-5): ", 0.0, 5.0);
+    printf("Enter your review: ");
+    getchar(); // Clear buffer
+    fgets(review, 100, stdin);
+    review[strcspn(review, "\n")] = 0;
+
+    reviewProduct(i, rating, review);
+    printf("Thank you for your feedback!\n");
+}
+
+// Show a product's reviews, newest first, a page at a time
+void viewProductReviews() {
+    if (activeProductCount == 0) {
+        printf("No products available.\n");
+        return;
+    }
+    int serial = getProductSerial("Enter the product serial number (0 to cancel): ", 0);
+    if (serial == 0) return;
+    Product *product = productAt(serial - 1);
+    if (product->reviewCount == 0) {
+        printf("%s has no reviews yet.\n", product->name);
+        return;
+    }
+
+    printf("\nReviews of %s, rated %.2f:\n", product->name, product->rating);
+    int page[PAGE_SIZE];
+    int cursor = -1, shown = 0;
+    do {
+        int count = pageReviews(serial - 1, cursor, PAGE_SIZE, page);
+        for (int i = 0; i < count; i++) {
+            bufferPrintf(&screen, "Rating: %.2f\n%s\n------------------------\n", reviewAt(page[i])->rating,
+                         reviewAt(page[i])->text);
+        }
+        flushScreen();
+        shown += count;
+        if (count > 0) cursor = page[count - 1];
+    } while (askNextPage(shown, product->reviewCount));
+}
+
+// Show the best rated products, the best sellers or the cheapest products
+// of a category
+void viewTopProducts() {
+    int results[TOP_VIEW_SIZE];
+    int count;
+    int choice = getIntegerInput("Top products:\n1. Best Rated\n2. Best Sellers\n3. Cheapest in a Category\nEnter your choice: ", 1, 3);
+
+    if (choice == 1) {
+        printf("\nBest rated products:\n");
+        count = topProducts(TOP_RATED, NULL, TOP_VIEW_SIZE, results);
+    } else if (choice == 2) {
+        printf("\nBest selling products:\n");
+        count = topProducts(TOP_SELLERS, NULL, TOP_VIEW_SIZE, results);
+    } else {
+        char category[50];
+        printf("Enter category: ");
+        scanf("%49s", category);
+        printf("\nCheapest products in '%s' after discount:\n", category);
+        count = topProducts(TOP_CHEAPEST, category, TOP_VIEW_SIZE, results);
+    }
+
+    for (int i = 0; i < count; i++) {
+        Product *product = productAt(results[i]);
+        bufferPrintf(&screen, "Rank: %d\n", i + 1);
+        if (choice == 2) {
+            bufferPrintf(&screen, "Units sold: %d\n", *productSales(results[i]));
+        } else if (choice == 3) {
+            bufferPrintf(&screen, "Price after discount: %.2f\n", product->price * (1 - product->discount / 100));
+        }
+        renderProduct(&screen, results[i], 1);
+    }
+    flushScreen();
+    if (count == 0) printf("No products to show.\n");
+}
+
+// Validate mobile number (11 digits, starting with 018/019/017/013/014/015/016)
+int validateMobileNumber(char *number) {
+    if (strlen(number) != 11) {
+        printf("Mobile number must be 11 digits.\n");
+        return 0;
+    }
+
+    for (int i = 0; i < 11; i++) {
+        if (!isdigit(number[i])) {
+            printf("Mobile number must contain only digits.\n");
+            return 0;
+        }
+    }
+
+    char prefix[4];
+    strncpy(prefix, number, 3);
+    prefix[3] = '\0';
+    const char *validPrefixes[] = {"018", "019", "017", "013", "014", "015", "016"};
+
+    for (int i = 0; i < 7; i++) {
+        if (strcmp(prefix, validPrefixes[i]) == 0) {
+            return 1;
+        }
+    }
+
+    printf("Mobile number must start with 018, 019, 017, 013, 014, 015, or 016.\n");
+    return 0;
+}
+
+// Monotonic clock in nanoseconds, for operation statistics
+long long statNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
 
-        switch (choice) {
-            case 1:
-                addProduct();
-                break;
-            case 2:
-                removeProduct();
-                break;
-            case 3:
-                updateDiscount();
-                break;
-            case 4:
-                viewOrderHistory();
-                break;
-            case 5:
-                displayProducts();
-                break;
-            case 6:
-                printf("Logged out.\n");
-                break;
+// Count one call of an operation that began at started
+void statRecord(int stat, long long started, long long bytes) {
+    OperationStats *stats = &operationStats[stat];
+    long long elapsed = statNow() - started;
+    int bucket = elapsed > 0 ? 63 - __builtin_clzll(elapsed) : 0;
+    if (bucket >= STAT_BUCKETS) bucket = STAT_BUCKETS - 1;
+
+    __atomic_add_fetch(&stats->calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->totalNanos, elapsed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->buckets[bucket], 1, __ATOMIC_RELAXED);
+    long long longest = __atomic_load_n(&stats->maxNanos, __ATOMIC_RELAXED);
+    while (elapsed > longest &&
+           !__atomic_compare_exchange_n(&stats->maxNanos, &longest, elapsed, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Upper bound in nanoseconds of the histogram bucket holding the given
+// fraction of calls
+long long statPercentile(OperationStats *stats, double fraction) {
+    long long wanted = (long long)(stats->calls * fraction), seen = 0;
+    for (int i = 0; i < STAT_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen > wanted) return (2LL << i) < stats->maxNanos ? (2LL << i) : stats->maxNanos;
+    }
+    return stats->maxNanos;
+}
+
+// Format the counters of every operation that has run, as a text table
+// or as JSON
+void formatStats(Buffer *out, int json) {
+    if (json) bufferPrintf(out, "{\n  \"operations\": {");
+    else bufferPrintf(out, "%-14s %10s %14s %12s %10s %10s %10s %10s\n",
+                      "operation", "calls", "bytes", "total (ms)", "mean (us)", "p50 (us)", "p99 (us)", "max (us)");
+
+    int first = 1;
+    for (int i = 0; i < STAT_COUNT; i++) {
+        OperationStats *stats = &operationStats[i];
+        if (stats->calls == 0) continue;
+        double mean = stats->totalNanos / 1e3 / stats->calls;
+        if (!json) {
+            bufferPrintf(out, "%-14s %10lld %14lld %12.2f %10.2f %10.2f %10.2f %10.2f\n",
+                         statNames[i], stats->calls, stats->bytes, stats->totalNanos / 1e6, mean,
+                         statPercentile(stats, 0.5) / 1e3, statPercentile(stats, 0.99) / 1e3, stats->maxNanos / 1e3);
+            continue;
         }
-    } while (choice != 6);
+
+        bufferPrintf(out, "%s\n    \"%s\": {\"calls\": %lld, \"bytes\": %lld, \"total_ns\": %lld, "
+                     "\"p50_ns\": %lld, \"p99_ns\": %lld, \"max_ns\": %lld, \"histogram_ns\": {",
+                     first ? "" : ",", statNames[i], stats->calls, stats->bytes, stats->totalNanos,
+                     statPercentile(stats, 0.5), statPercentile(stats, 0.99), stats->maxNanos);
+        int firstBucket = 1;
+        for (int b = 0; b < STAT_BUCKETS; b++) {
+            if (stats->buckets[b] == 0) continue;
+            bufferPrintf(out, "%s\"%lld\": %lld", firstBucket ? "" : ", ", 2LL << b, stats->buckets[b]);
+            firstBucket = 0;
+        }
+        bufferPrintf(out, "}}");
+        first = 0;
+    }
+    if (json) bufferPrintf(out, "\n  }\n}\n");
 }
 
-// User panel
-void userPanel(char *username) {
-    int choice;
-    do {
-        printf("\nUser Panel - Welcome %s\n", username);
-        printf("1. View Products\n");
-        printf("2. Search Products\n");
-        printf("3. Add to Cart\n");
-        printf("4. View My Orders\n");
-        printf("5. Checkout\n");
-        printf("6. Review Products\n");
-        printf("7. Logout\n");
-        printf("Enter your choice: ");
-        choice = getIntegerInput("", 1, 7);
+// Admin view of the operation statistics
+void showStats() {
+#ifndef NO_STATS
+    printf("\nOperation Statistics:\n");
+    formatStats(&screen, 0);
+    flushScreen();
+#else
+    printf("Statistics are not available in this build.\n");
+#endif
+}
 
-        switch (choice) {
-            case 1:
-                displayProducts();
-                break;
-            case 2:
-                searchProducts();
-                break;
-            case 3:
-                addToCart(username);
-                break;
-            case 4:
-                displayUserOrders(username);
-                break;
-            case 5:
-                checkout(username);
-                break;
-            case 6:
-                provideRatingAndReview(username);
-                break;
-            case 7:
-                printf("Logged out.\n");
-                break;
+// Write the operation statistics as JSON
+void writeStatsFile() {
+#ifndef NO_STATS
+    Buffer out = {NULL, 0, 0};
+    formatStats(&out, 1);
+    FILE *file = fopen(FILENAME_STATS, "w");
+    if (file != NULL) {
+        fwrite(out.data, 1, out.length, file);
+        fclose(file);
+    }
+    free(out.data);
+#endif
+}
+
+#if !defined(_WIN32) && !defined(NO_STATS)
+// Write the statistics file whenever SIGUSR1 arrives
+void *statsSignalWorker(void *arg) {
+    sigset_t *signals = arg;
+    int signalNumber;
+    while (sigwait(signals, &signalNumber) == 0) {
+        writeStatsFile();
+    }
+    return NULL;
+}
+#endif
+
+// Handle SIGUSR1 on a thread of its own, so the statistics can be dumped
+// at any time without touching the menus or sessions. Must run before any
+// other thread starts, so they all inherit the blocked signal.
+void startStatsSignalThread() {
+#if !defined(_WIN32) && !defined(NO_STATS)
+    static sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_t thread;
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) == 0 &&
+        pthread_create(&thread, NULL, statsSignalWorker, &signals) == 0) {
+        pthread_detach(thread);
+    }
+#endif
+}
+
+// Monotonic clock in seconds, for benchmarks
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Small deterministic generator so benchmark runs are repeatable
+unsigned int benchSeed = 12345;
+
+unsigned int benchRandom() {
+    benchSeed ^= benchSeed << 13;
+    benchSeed ^= benchSeed >> 17;
+    benchSeed ^= benchSeed << 5;
+    return benchSeed;
+}
+
+// Grow the in-memory catalog to count synthetic products. Category
+// popularity is skewed so a few categories hold most of the catalog.
+void generateBenchProducts(int count) {
+    for (int i = productCount; i < count; i++) {
+        Product *product = poolReserve(&productPool, i);
+        unsigned int r = benchRandom() % 1000;
+        int category = (r * r) / 10000; // 0..99, denser near 0
+        char categoryName[50];
+        sprintf(product->name, "item%d", i);
+        sprintf(categoryName, "cat%d", category);
+        product->category = categoryId(categoryName);
+        product->price = (float)(benchRandom() % 10000000) / 100.0f + 1.0f;
+        product->stock = 1 + benchRandom() % 1000;
+        product->discount = (float)(benchRandom() % 50);
+        // A synthetic rating without review records behind it
+        product->rating = (float)(benchRandom() % 500) / 100.0f;
+        product->reviewCount = 0;
+        product->ratingSum = 0;
+        product->latestReview = -1;
+        product->deleted = 0;
+        indexInsert(&productIndex, product->name, i);
+    }
+    activeProductCount += count - productCount;
+    productCount = count;
+    buildSearchIndexes();
+}
+
+// Grow the user list to count synthetic accounts userN / passN
+void generateBenchUsers(int count) {
+    for (int i = userCount; i < count; i++) {
+        User user;
+        memset(&user, 0, sizeof(user));
+        sprintf(user.username, "user%d", i);
+        sprintf(user.password, "pass%d", i);
+        appendUser(&user);
+    }
+}
+
+// Logins per second over a fixed set of random accounts, one in ten with a
+// wrong password. scan compares every account like the old login did.
+double timeLogins(int scan, int logins) {
+    int accepted = 0;
+    double start = nowSeconds();
+    benchSeed = 999;
+    for (int i = 0; i < logins; i++) {
+        char username[50], password[PASSWORD_LENGTH];
+        int user = benchRandom() % userCount;
+        sprintf(username, "user%d", user);
+        sprintf(password, benchRandom() % 10 == 0 ? "wrong%d" : "pass%d", user);
+        if (scan) {
+            for (int j = 0; j < userCount; j++) {
+                if (strcmp(userAt(j)->username, username) == 0 && strcmp(userAt(j)->password, password) == 0) {
+                    accepted++;
+                    break;
+                }
+            }
+        } else {
+            accepted += authenticateUser(username, password) == 0;
         }
-    } while (choice != 7);
+    }
+    double seconds = nowSeconds() - start;
+    return accepted > 0 ? logins / seconds : 0.0;
 }
 
-// Display orders for a specific user
-void displayUserOrders(char *username) {
-    printf("\nYour Orders:\n");
-    int found = 0;
-    for (int i = 0; i < orderCount; i++) {
-        if (strcmp(orders[i].username, username) == 0) {
-            printf("Order ID: %d\n", orders[i].orderId);
-            printf("Product: %s\n", orders[i].productName);
-            printf("Quantity: %d\n", orders[i].quantity);
-            printf("Total Price: %.2f\n", orders[i].totalPrice);
-            printf("Payment Method: %s\n", orders[i].paymentMethod);
-            printf("Delivery Address: %s\n", orders[i].address);
-            printf("------------------------\n");
-            found = 1;
-        }
-    }
-    if (!found) {
-        printf("You have no orders yet.\n");
+// bench login [sizes...]: login throughput against growing account lists
+int benchLogin(int argc, char *argv[]) {
+    int defaultSizes[] = {10000, 1000000, 5000000};
+    int sizeCount = argc > 0 ? argc : 3;
+
+    printf("%-10s %16s %16s %10s\n", "accounts", "scan (logins/s)", "index (logins/s)", "speedup");
+    for (int i = 0; i < sizeCount; i++) {
+        int size = argc > 0 ? atoi(argv[i]) : defaultSizes[i];
+        if (size < 1 || size < userCount) {
+            printf("Sizes must be positive and increasing.\n");
+            return 1;
+        }
+        generateBenchUsers(size);
+
+        // Keep the scan to a few seconds on large account lists
+        int scanLogins = size >= 1000000 ? 20 : 2000;
+        double scan = timeLogins(1, scanLogins);
+        double indexed = timeLogins(0, 1000000);
+        printf("%-10d %16.0f %16.0f %9.0fx\n", size, scan, indexed, indexed / scan);
     }
+    return 0;
 }
 
-// Add a new product (admin only)
-void addProduct() {
-    if (productCount >= MAX_PRODUCTS) {
-        printf("Product limit reached. Cannot add more products.\n");
-        return;
+// Average microseconds per query over a fixed set of random queries
+// mode 0 scans the product records, 1 uses the sorted indexes and 2 scans
+// the product columns
+double timeSearchQueries(int mode, int kind, int queries) {
+    int *results;
+    double start = nowSeconds();
+    benchSeed = 777;
+    for (int q = 0; q < queries; q++) {
+        char category[50];
+        unsigned int r = benchRandom() % 1000;
+        sprintf(category, "cat%u", (r * r) / 10000);
+        float minPrice = (float)(benchRandom() % 9990000) / 100.0f;
+        float maxPrice = minPrice + 100.0f; // roughly 0.1% of the price range
+
+        const char *queryCategory = (kind == 2) ? NULL : category;
+        int byPrice = (kind != 1);
+        if (mode == 1) {
+            findMatchingProducts(queryCategory, byPrice, minPrice, maxPrice, &results);
+        } else if (mode == 2) {
+            Category *match = queryCategory != NULL ? findCategory(queryCategory, 0) : NULL;
+            ProductFilter filter = {match != NULL ? (int)(match - categories) : -1, 0,
+                                    byPrice ? minPrice : -FLT_MAX, byPrice ? maxPrice : FLT_MAX, -FLT_MAX, 0};
+            filterProducts(&filter, &results);
+        } else {
+            scanMatchingProducts(queryCategory, byPrice, minPrice, maxPrice, &results);
+        }
+        free(results);
     }
+    return (nowSeconds() - start) * 1e6 / queries;
+}
 
-    Product newProduct;
-    printf("Enter product name (max 49 chars): ");
-    scanf("%49s", newProduct.name);
-    printf("Enter product category (max 49 chars): ");
-    scanf("%49s", newProduct.category);
-    newProduct.price = getFloatInput("Enter product price: ", 0.01, 1000000.0);
-    newProduct.stock = getIntegerInput("Enter product stock: ", 1, 1000000);
-    newProduct.discount = getFloatInput("Enter product discount (%): ", 0.0, 100.0);
-    newProduct.rating = 0;
-    strcpy(newProduct.reviews, "No reviews yet.");
-
-    products[productCount++] = newProduct;
-    saveProducts();
-    printf("Product added successfully!\n");
+// bench search [sizes...]: row scan vs columnar scan vs indexed
+// searchProducts latency
+int benchSearch(int argc, char *argv[]) {
+    int defaultSizes[] = {10000, 1000000, 10000000};
+    int sizeCount = argc > 0 ? argc : 3;
+    const char *kinds[] = {"", "category", "price range", "both"};
+    const char *levels[] = {"scalar", "SSE2", "AVX2"};
+
+    if (simdLevel < 0) simdLevel = detectSimdLevel();
+    printf("Columnar scans use %s.\n", levels[simdLevel]);
+    printf("%-10s %-12s %14s %14s %14s %10s\n", "products", "query", "scan (us)", "columnar (us)", "indexed (us)", "speedup");
+    for (int i = 0; i < sizeCount; i++) {
+        int size = argc > 0 ? atoi(argv[i]) : defaultSizes[i];
+        if (size < 1 || size < productCount) {
+            printf("Sizes must be positive and increasing.\n");
+            return 1;
+        }
+        generateBenchProducts(size);
+
+        // Keep each scan measurement to a few seconds on large catalogs
+        int scanQueries = size >= 1000000 ? 10 : 200;
+        for (int kind = 1; kind <= 3; kind++) {
+            double scan = timeSearchQueries(0, kind, scanQueries);
+            double columnar = timeSearchQueries(2, kind, scanQueries * 10);
+            double indexed = timeSearchQueries(1, kind, scanQueries * 10);
+            printf("%-10d %-12s %14.2f %14.2f %14.2f %9.1fx\n", size, kinds[kind], scan, columnar, indexed, scan / indexed);
+        }
+    }
+    return 0;
 }
 
-// Remove a product (admin only)
-void removeProduct() {
-    if (productCount == 0) {
-        printf("No products available to delete.\n");
-        return;
+// Move into a fresh scratch directory so benchmarks never touch real data
+int enterBenchDirectory() {
+#ifndef _WIN32
+    char path[] = "/tmp/ecommerce-bench-XXXXXX";
+    if (mkdtemp(path) == NULL || chdir(path) != 0) {
+        printf("Could not create a scratch directory.\n");
+        return 0;
     }
+    printf("Benchmark files go to %s\n", path);
+    return 1;
+#else
+    printf("This benchmark needs a POSIX system.\n");
+    return 0;
+#endif
+}
 
-    displayProducts();
-    int serial = getIntegerInput("Enter the serial number of the product to delete (0 to cancel): ", 0, productCount);
+// Fill a user's cart with items products spread over the catalog
+CustomerOrders *fillBenchCart(int items) {
+    for (int i = 0; i < items; i++) {
+        Order order;
+        memset(&order, 0, sizeof(order));
+        order.orderId = lastOrderId + 1;
+        order.customer = (int)(findCustomerOrders("bench", 1) - customers);
+        order.product = benchRandom() % productCount;
+        order.quantity = 1;
+        order.totalPrice = 1;
+        order.address = internString("Bench Street");
+        order.paymentMethod = -1;
+        order.status = ORDER_PENDING;
+        appendOrder(&order);
+    }
+    return findCustomerOrders("bench", 0);
+}
 
-    if (serial == 0) {
-        printf("Product deletion cancelled.\n");
-        return;
+// bench checkout [catalog size]: checkout latency by cart size for the old
+// per-item path (updateStock and a full products.txt rewrite per item),
+// per-item log appends, and the batched commit
+int benchCheckout(int argc, char *argv[]) {
+    int catalog = argc > 0 ? atoi(argv[0]) : 10000;
+    int cartSizes[] = {1, 5, 10, 25, 50};
+    if (catalog < 1 || !enterBenchDirectory()) return 1;
+
+    generateBenchProducts(catalog);
+    for (int i = 0; i < productCount; i++) {
+        productAt(i)->stock = 1000000; // nothing sells out during the run
     }
+    openChangeLog();
 
-    // Shift products after the deleted one
-    for (int i = serial - 1; i < productCount - 1; i++) {
-        products[i] = products[i + 1];
+    printf("%-10s %18s %18s %18s\n", "cart size", "rewrite/item (ms)", "log/item (ms)", "batched (ms)");
+    for (int c = 0; c < 5; c++) {
+        int items = cartSizes[c];
+        int rounds = 20;
+        double elapsed[3] = {0, 0, 0};
+        for (int r = 0; r < rounds; r++) {
+            for (int mode = 0; mode < 3; mode++) {
+                CustomerOrders *customer = fillBenchCart(items);
+                double start = nowSeconds();
+                if (mode == 2) {
+                    commitCheckout(customer, "Bkash");
+                } else {
+                    for (int i = 0; i < customer->pending.count; i++) {
+                        Order *order = orderAt(customer->pending.slots[i]);
+                        order->status = ORDER_PAID;
+                        order->paymentMethod = internString("Bkash");
+                        logChange("paid %d %s\n", order->orderId, stringAt(order->paymentMethod));
+                        updateStock(productAt(order->product)->name, order->quantity);
+                        if (mode == 0) saveProducts();
+                    }
+                    customer->pending.count = 0;
+                }
+                elapsed[mode] += nowSeconds() - start;
+            }
+        }
+        printf("%-10d %18.3f %18.3f %18.3f\n", items,
+               elapsed[0] * 1e3 / rounds, elapsed[1] * 1e3 / rounds, elapsed[2] * 1e3 / rounds);
     }
-    productCount--;
-    saveProducts();
-    printf("Product deleted successfully.\n");
+    return 0;
 }
 
-// Update discount for a product (admin only)
-void updateDiscount() {
-    if (productCount == 0) {
-        printf("No products available to update.\n");
-        return;
+// Random index below count, skewed so low indexes come up far more often
+int benchSkewed(int count) {
+    unsigned long long r = benchRandom() % 1000000;
+    return (int)(r * r / 1000000 * count / 1000000);
+}
+
+// Write a synthetic store in the text file formats: users and products
+// with skewed popularity, prices skewed towards the cheap end, and orders
+// whose totals match the product they name
+int generateDataset(int users, int products, int orders) {
+    static const char *methods[] = {"Visa/Mastercard", "Bkash", "Nagad"};
+    static const char *reviews[] = {"No reviews yet.", "Good value", "Works as described", "Arrived late", "Excellent quality"};
+    static const char *cities[] = {"Dhaka", "Chittagong", "Khulna", "Rajshahi", "Sylhet"};
+    float *price = malloc((size_t)products * sizeof(float));
+    float *discount = malloc((size_t)products * sizeof(float));
+    if (price == NULL || discount == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
     }
 
-    displayProducts();
-    int serial = getIntegerInput("Enter the serial number of the product to update discount: ", 1, productCount);
-    float discount = getFloatInput("Enter new discount (%): ", 0.0, 100.0);
+    FILE *file = fopen(FILENAME_USERS, "w");
+    if (file == NULL) {
+        printf("Error saving user data.\n");
+        return 0;
+    }
+    for (int i = 0; i < users; i++) {
+        fprintf(file, "user%d pass%d 0\n", i, i);
+    }
+    fclose(file);
+
+    file = fopen(FILENAME_PRODUCTS, "w");
+    FILE *reviewFile = fopen(FILENAME_REVIEWS, "w");
+    if (file == NULL || reviewFile == NULL) {
+        printf("Error saving product data.\n");
+        return 0;
+    }
+    for (int i = 0; i < products; i++) {
+        double u = (double)(benchRandom() % 1000000) / 1000000.0;
+        price[i] = (float)(int)(u * u * u * 100000.0 * 100) / 100.0f + 1.0f;
+        discount[i] = benchRandom() % 10 < 7 ? 0.0f : (float)(5 * (1 + benchRandom() % 10));
+        int reviewed = benchRandom() % 3 == 0;
+        float rating = reviewed ? (float)(benchRandom() % 500) / 100.0f : 0.0f;
+        const char *review = reviews[reviewed ? 1 + benchRandom() % 4 : 0];
+        fprintf(file, "item%d cat%d %.2f %u %.2f %.2f %s\n",
+                i,
+                benchSkewed(100),
+                price[i],
+                1 + benchRandom() % 1000,
+                discount[i],
+                rating,
+                review);
+        if (reviewed) fprintf(reviewFile, "item%d %.2f %s\n", i, rating, review);
+    }
+    fclose(file);
+    fclose(reviewFile);
+
+    file = fopen(FILENAME_ORDERS, "w");
+    if (file == NULL) {
+        printf("Error saving order data.\n");
+        return 0;
+    }
+    for (int i = 0; i < orders; i++) {
+        int product = benchSkewed(products);
+        int quantity = 1 + benchSkewed(5);
+        int pending = benchRandom() % 10 == 0;
+        fprintf(file, "%d user%d item%d %d %.2f %s House %u, Road %u, %s\n",
+                i + 1,
+                benchSkewed(users),
+                product,
+                quantity,
+                price[product] * quantity * (1 - discount[product] / 100),
+                pending ? "Pending" : methods[benchRandom() % 3],
+                1 + benchRandom() % 200,
+                1 + benchRandom() % 50,
+                cities[benchRandom() % 5]);
+    }
+    fclose(file);
+
+    free(price);
+    free(discount);
+    return 1;
+}
+
+// generate PRODUCTS ORDERS [USERS]: write a synthetic dataset into the
+// current directory's text files
+int runGenerate(int argc, char *argv[]) {
+    int products = argc > 0 ? atoi(argv[0]) : 0;
+    int orders = argc > 1 ? atoi(argv[1]) : 0;
+    int users = argc > 2 ? atoi(argv[2]) : orders / 10 + 1;
+    if (products < 1 || orders < 0 || users < 1) {
+        printf("Usage: project generate PRODUCTS ORDERS [USERS]\n");
+        return 1;
+    }
+
+    double start = nowSeconds();
+    if (!generateDataset(users, products, orders)) return 1;
+    printf("Wrote %d users, %d products and %d orders in %.1f s.\n", users, products, orders, nowSeconds() - start);
+    printf("Run 'project import' to load them in place of any existing snapshot.\n");
+    return 0;
+}
 
-    products[serial - 1].discount = discount;
+// analytics [THREADS]: print the sales report over the current directory's
+// order history without loading the rest of the data
+int runAnalytics(int argc, char *argv[]) {
+    int threads = argc > 0 ? atoi(argv[0]) : 0;
+    if (threads < 0 || threads > LOAD_MAX_THREADS) {
+        printf("Usage: project analytics [threads, 1..%d]\n", LOAD_MAX_THREADS);
+        return 1;
+    }
+
+    SalesReport report;
+    if (!analyzeHistory(threads, &report)) {
+        if (report.bytes == 0) printf("No order history found.\n");
+        freeSalesReport(&report);
+        return 1;
+    }
+    formatSalesReport(&screen, &report);
+    bufferPrintf(&screen, "\nRead %.1f MB in %.2f s with %d threads.\n", report.bytes / 1048576.0, report.seconds, report.threads);
+    flushScreen();
+    freeSalesReport(&report);
+    return 0;
+}
+
+// Compare two doubles for qsort
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Print throughput and p50/p99 latency for count timed operations
+void reportLatencies(const char *name, double *samples, int count) {
+    double total = 0;
+    for (int i = 0; i < count; i++) total += samples[i];
+    qsort(samples, count, sizeof(double), compareDoubles);
+    printf("%-14s %10d %14.0f %12.2f %12.2f\n", name, count,
+           total > 0 ? count / total : 0.0,
+           samples[count / 2] * 1e6,
+           samples[(int)(count * 0.99)] * 1e6);
+}
+
+// bench suite [products] [orders]: generate a dataset, then time loading,
+// searches, logins, add-to-cart, checkout, reviews and saving
+int benchSuite(int argc, char *argv[]) {
+    int products = argc > 0 ? atoi(argv[0]) : 100000;
+    int orders = argc > 1 ? atoi(argv[1]) : 1000000;
+    int users = orders / 10 + 1;
+    int operations = 10000;
+    if (products < 1 || orders < 1 || !enterBenchDirectory()) return 1;
+
+    double start = nowSeconds();
+    generateDataset(users, products, orders);
+    printf("generate       %.2f s (%d users, %d products, %d orders)\n", nowSeconds() - start, users, products, orders);
+
+    start = nowSeconds();
+    loadData();
+    printf("load (text)    %.2f s\n", nowSeconds() - start);
+    start = nowSeconds();
+    saveSnapshot();
+    printf("save snapshot  %.2f s\n", nowSeconds() - start);
+    start = nowSeconds();
+    saveUsers();
     saveProducts();
-    printf("Discount updated successfully!\n");
+    saveOrders();
+    printf("save text      %.2f s\n", nowSeconds() - start);
+
+    // The generated orders count as already placed; history only gets
+    // the orders checked out below
+    saveOrderHistory();
+    openChangeLog();
+
+    double *samples = malloc(operations * sizeof(double));
+    if (samples == NULL) {
+        printf("Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("\n%-14s %10s %14s %12s %12s\n", "operation", "count", "ops/sec", "p50 (us)", "p99 (us)");
+
+    benchSeed = 4242;
+    for (int i = 0; i < operations; i++) {
+        char category[50];
+        int *results;
+        sprintf(category, "cat%d", benchSkewed(100));
+        float minPrice = (float)(benchRandom() % 100000);
+        int kind = i % 3;
+        double opStart = nowSeconds();
+        findMatchingProducts(kind == 1 ? NULL : category, kind != 0, minPrice, minPrice + 100, &results);
+        samples[i] = nowSeconds() - opStart;
+        free(results);
+    }
+    reportLatencies("search", samples, operations);
+
+    int failedLogins = 0;
+    for (int i = 0; i < operations; i++) {
+        char username[50], password[PASSWORD_LENGTH];
+        int user = benchRandom() % users;
+        sprintf(username, "user%d", user);
+        sprintf(password, "pass%d", user);
+        double opStart = nowSeconds();
+        failedLogins += authenticateUser(username, password) != 0;
+        samples[i] = nowSeconds() - opStart;
+    }
+    reportLatencies("login", samples, operations);
+    if (failedLogins > 0) printf("%d logins failed\n", failedLogins);
+
+    for (int i = 0; i < operations; i++) {
+        char username[50];
+        int orderId;
+        sprintf(username, "shopper%d", i % (operations / 5));
+        int slot = benchSkewed(productCount);
+        double opStart = nowSeconds();
+        placeInCart(username, slot, 1, "House 1, Road 1, Dhaka", &orderId);
+        samples[i] = nowSeconds() - opStart;
+    }
+    reportLatencies("add-to-cart", samples, operations);
+
+    // Each shopper now has a cart of about five items
+    int shoppers = operations / 5;
+    for (int i = 0; i < shoppers; i++) {
+        char username[50];
+        int items;
+        float total;
+        sprintf(username, "shopper%d", i);
+        double opStart = nowSeconds();
+        checkoutCart(username, "Bkash", &items, &total);
+        samples[i] = nowSeconds() - opStart;
+    }
+    reportLatencies("checkout", samples, shoppers);
+
+    for (int i = 0; i < operations; i++) {
+        int slot = benchSkewed(productCount);
+        double opStart = nowSeconds();
+        reviewProduct(slot, (float)(benchRandom() % 500) / 100.0f, "Bench review");
+        samples[i] = nowSeconds() - opStart;
+    }
+    reportLatencies("review", samples, operations);
+
+    free(samples);
+    start = nowSeconds();
+    compactChangeLog();
+    printf("\ncompact        %.2f s\n", nowSeconds() - start);
+    return 0;
+}
+
+// Fingerprint of the fields of count loaded records of one data file
+// (0 users, 1 products, 2 orders), to check two loaders read the same
+unsigned long long fingerprintRecords(int file, Pool *pool, int count) {
+    unsigned long long sum = count;
+    for (int i = 0; i < count; i++) {
+        char *record = pool->chunks[i >> POOL_CHUNK_SHIFT] + (size_t)(i & (POOL_CHUNK_SIZE - 1)) * pool->recordSize;
+        unsigned int fields[7];
+        if (file == 0) {
+            User *user = (User *)record;
+            fields[0] = hashString(user->username);
+            fields[1] = hashString(user->password);
+            fields[2] = (unsigned int)user->isAdmin;
+            fields[3] = fields[4] = fields[5] = fields[6] = 0;
+        } else if (file == 1) {
+            ProductLine *product = (ProductLine *)record;
+            fields[0] = hashString(product->name);
+            fields[1] = hashString(product->category);
+            memcpy(&fields[2], &product->price, sizeof(float));
+            fields[3] = (unsigned int)product->stock;
+            memcpy(&fields[4], &product->discount, sizeof(float));
+            memcpy(&fields[5], &product->rating, sizeof(float));
+            fields[6] = 0;
+        } else {
+            OrderLine *order = (OrderLine *)record;
+            fields[0] = (unsigned int)order->orderId;
+            fields[1] = hashString(order->username);
+            fields[2] = hashString(order->productName);
+            fields[3] = (unsigned int)order->quantity;
+            memcpy(&fields[4], &order->totalPrice, sizeof(float));
+            fields[5] = hashString(order->paymentMethod);
+            fields[6] = hashString(order->address);
+        }
+        for (int f = 0; f < 7; f++) sum = sum * 1000003 + fields[f];
+    }
+    return sum;
+}
+
+// bench load [megabytes] [threads]: write text files of about the given
+// size, then time reading each with fscanf and with the zero-copy parser
+// on one and on several threads, checking that all read the same records
+int benchLoad(int argc, char *argv[]) {
+    static const char *files[] = {FILENAME_USERS, FILENAME_PRODUCTS, FILENAME_ORDERS};
+    RecordScanner scanners[] = {scanUser, scanProduct, scanOrder};
+    RecordReader readers[] = {readUser, readProduct, readOrder};
+    size_t recordSizes[] = {sizeof(User), sizeof(ProductLine), sizeof(OrderLine)};
+    int megabytes = argc > 0 ? atoi(argv[0]) : 1024;
+#ifndef _WIN32
+    int threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    int threads = 1;
+#endif
+    if (megabytes < 1 || threads < 1 || threads > LOAD_MAX_THREADS) {
+        printf("Usage: project bench load [megabytes] [threads, 1..%d]\n", LOAD_MAX_THREADS);
+        return 1;
+    }
+    if (!enterBenchDirectory()) return 1;
+
+    // Order lines take about 70 bytes and product lines 50; give orders
+    // three quarters of the data, as in a store with some history
+    long long bytes = (long long)megabytes * 1024 * 1024;
+    int orders = (int)(bytes * 3 / 4 / 70);
+    int products = (int)(bytes / 4 / 50);
+    double start = nowSeconds();
+    generateDataset(orders / 10 + 1, products, orders);
+    printf("generate       %.2f s\n\n", nowSeconds() - start);
+
+    int modes[] = {-1, 1, threads};
+    int mismatches = 0;
+    printf("%-14s %8s %10s %12s %12s %12s %9s\n", "file", "MB", "records", "fscanf (s)", "1 thread (s)", "threads (s)", "speedup");
+    for (int f = 0; f < 3; f++) {
+        unsigned long long expected = 0;
+        double seconds[3];
+        long long size = 0;
+        int count = 0;
+        for (int m = 0; m < 3; m++) {
+            Pool pool = {recordSizes[f], NULL, 0, 0};
+            count = 0;
+            loadThreads = modes[m];
+            start = nowSeconds();
+            size = loadTextRecords(files[f], &pool, &count, scanners[f], readers[f]);
+            seconds[m] = nowSeconds() - start;
+            unsigned long long fingerprint = fingerprintRecords(f, &pool, count);
+            if (m == 0) {
+                expected = fingerprint;
+            } else if (fingerprint != expected) {
+                mismatches++;
+            }
+            for (int c = 0; c < pool.chunkCount; c++) free(pool.chunks[c]);
+            free(pool.chunks);
+        }
+        printf("%-14s %8.1f %10d %12.3f %12.3f %12.3f %8.1fx\n", files[f], size / 1048576.0, count,
+               seconds[0], seconds[1], seconds[2], seconds[0] / seconds[2]);
+    }
+    loadThreads = 0;
+    printf("\n%d threads. %s\n", threads,
+           mismatches == 0 ? "All loaders read the same records." : "Loaders read DIFFERENT records.");
+    return mismatches != 0;
+}
+
+// Word n of the text benchmark's vocabulary, three syllables long, so
+// that words share prefixes the way real ones do
+void benchWord(int n, char *word) {
+    static const char *syllables[] = {"ba", "ko", "ri", "mu", "sel", "ta", "no", "vi",
+                                      "den", "lo", "ga", "pi", "ster", "fu", "ne", "ru"};
+    word[0] = '\0';
+    for (n += 256; n > 0; n /= 16) {
+        strcat(word, syllables[n % 16]);
+    }
+}
+
+// Microseconds per text query of one kind over a fixed set of random
+// queries, and the mean number of results through *found
+double timeTextQueries(int kind, int queries, double *found) {
+    int results[TEXT_RESULTS_MAX];
+    long long total = 0;
+    double start = nowSeconds();
+    benchSeed = 4242;
+    for (int q = 0; q < queries; q++) {
+        char query[100], word[TERM_LENGTH], other[TERM_LENGTH];
+        benchWord(benchSkewed(2000), word);
+        benchWord(benchSkewed(2000), other);
+        if (kind == 0) {
+            strcpy(query, word);
+        } else if (kind == 1) {
+            sprintf(query, "%s %s", word, other);
+        } else if (kind == 2) {
+            word[4] = '\0';
+            strcpy(query, word);
+        } else if (kind == 3) {
+            word[2] = 'z'; // No syllable has a z, so this is always a typo
+            strcpy(query, word);
+        } else {
+            sprintf(query, "item %u", benchRandom() % productCount);
+        }
+        total += searchText(query, PAGE_SIZE, results);
+    }
+    *found = (double)total / queries;
+    return (nowSeconds() - start) * 1e6 / queries;
+}
+
+// bench text [sizes...]: keyword search latency on catalogs where every
+// fourth product has a review drawn from a 2,000-word vocabulary
+int benchText(int argc, char *argv[]) {
+    int defaultSizes[] = {10000, 100000, 1000000};
+    int sizeCount = argc > 0 ? argc : 3;
+    const char *kinds[] = {"word", "two words", "prefix", "typo", "name"};
+
+    printf("%-10s %-10s %14s %12s\n", "products", "query", "latency (us)", "results");
+    for (int i = 0; i < sizeCount; i++) {
+        int size = argc > 0 ? atoi(argv[i]) : defaultSizes[i];
+        if (size < 1 || size < productCount) {
+            printf("Sizes must be positive and increasing.\n");
+            return 1;
+        }
+        int first = productCount;
+        generateBenchProducts(size);
+        for (int slot = first + (4 - first % 4) % 4; slot < size; slot += 4) {
+            char text[100], a[TERM_LENGTH], b[TERM_LENGTH], c[TERM_LENGTH];
+            benchWord(benchSkewed(2000), a);
+            benchWord(benchSkewed(2000), b);
+            benchWord(benchSkewed(2000), c);
+            sprintf(text, "%s %s %s", a, b, c);
+            addReview(slot, (float)(1 + benchRandom() % 5), text);
+        }
+
+        double start = nowSeconds();
+        buildTextIndex();
+        printf("%-10d %-10s %14.0f %12d\n", size, "build", (nowSeconds() - start) * 1e6, termCount);
+        for (int kind = 0; kind < 5; kind++) {
+            double found;
+            double latency = timeTextQueries(kind, 2000, &found);
+            printf("%-10d %-10s %14.2f %12.1f\n", size, kinds[kind], latency, found);
+        }
+    }
+    return 0;
+}
+
+// bench top [sizes...]: reading the best rated list against sorting the
+// catalog for it, and a review followed by a read, which keeps the list
+// up to date and now and then rebuilds it
+int benchTop(int argc, char *argv[]) {
+    int defaultSizes[] = {10000, 100000, 1000000};
+    int sizeCount = argc > 0 ? argc : 3;
+    int results[TOP_VIEW_SIZE];
+
+    printf("%-10s %14s %14s %18s\n", "products", "sort (us)", "top list (us)", "review+list (us)");
+    for (int i = 0; i < sizeCount; i++) {
+        int size = argc > 0 ? atoi(argv[i]) : defaultSizes[i];
+        if (size < 1 || size < productCount) {
+            printf("Sizes must be positive and increasing.\n");
+            return 1;
+        }
+        generateBenchProducts(size);
+
+        int sorts = size >= 1000000 ? 3 : 30;
+        double start = nowSeconds();
+        for (int round = 0; round < sorts; round++) {
+            SortedEntry *entries = malloc(productCount * sizeof(SortedEntry));
+            if (entries == NULL) {
+                printf("Out of memory.\n");
+                exit(EXIT_FAILURE);
+            }
+            int count = 0;
+            for (int slot = 0; slot < productCount; slot++) {
+                if (productAt(slot)->deleted) continue;
+                entries[count].key = -productAt(slot)->rating;
+                entries[count++].slot = slot;
+            }
+            qsort(entries, count, sizeof(SortedEntry), compareSortedEntries);
+            free(entries);
+        }
+        double sorted = (nowSeconds() - start) * 1e6 / sorts;
+
+        topProducts(TOP_RATED, NULL, TOP_VIEW_SIZE, results);
+        start = nowSeconds();
+        for (int read = 0; read < 100000; read++) {
+            topProducts(TOP_RATED, NULL, TOP_VIEW_SIZE, results);
+        }
+        double listed = (nowSeconds() - start) * 1e6 / 100000;
+
+        start = nowSeconds();
+        for (int review = 0; review < 10000; review++) {
+            // Review the listed products half the time, so they move
+            int slot = review % 2 ? results[benchRandom() % TOP_VIEW_SIZE] : (int)(benchRandom() % productCount);
+            addReview(slot, (float)(benchRandom() % 6), "Bench review");
+            topProducts(TOP_RATED, NULL, TOP_VIEW_SIZE, results);
+        }
+        double updated = (nowSeconds() - start) * 1e6 / 10000;
+        printf("%-10d %14.2f %14.3f %18.3f\n", size, sorted, listed, updated);
+    }
+    return 0;
 }
 
-// View order history (admin only)
-void viewOrderHistory() {
-    printf("\nOrder History:\n");
-    FILE *file = fopen(FILENAME_ORDER_HISTORY, "r");
+// Write about megabytes of order history: checkouts of one to four lines
+// spread over a year, after a few lines in the old format without order
+// IDs or dates
+void writeBenchHistory(int megabytes) {
+    static const char *methods[] = {"Visa/Mastercard", "Bkash", "Nagad", "Cash on Delivery"};
+    FILE *file = fopen(FILENAME_ORDER_HISTORY, "w");
     if (file == NULL) {
-        printf("No order history found.\n");
+        printf("Error saving order history.\n");
         return;
     }
-
-    char line[500];
-    while (fgets(line, sizeof(line), file)) {
-        printf("%s", line);
+    long long bytes = (long long)megabytes * 1024 * 1024, written = 0;
+    for (int i = 0; i < 1000; i++) {
+        written += fprintf(file, "User: user%d, Product: item%d, Qty: %d, Total: %u.00, Method: Bkash, Address: Dhaka\n",
+                           benchSkewed(100000), benchSkewed(100000), 1 + benchSkewed(5), 1 + benchRandom() % 1000);
+    }
+    time_t start = 1700000000;
+    for (int orderId = 1; written < bytes;) {
+        char date[20];
+        time_t when = start + (time_t)orderId * 60; // One checkout a minute on average
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime(&when));
+        int user = benchSkewed(100000);
+        const char *method = methods[benchRandom() % 4];
+        for (int items = 1 + benchRandom() % 4; items > 0; items--, orderId++) {
+            int quantity = 1 + benchSkewed(5);
+            written += fprintf(file, "Order ID: %d, Date: %s, User: user%d, Product: item%d, Qty: %d, Total: %.2f, Method: %s, Address: House %u, Road %u, Dhaka\n",
+                               orderId, date, user, benchSkewed(100000), quantity,
+                               quantity * (float)(benchRandom() % 1000000) / 100.0f, method,
+                               1 + benchRandom() % 200, 1 + benchRandom() % 50);
+        }
     }
     fclose(file);
 }
 
-// Display all products
-void displayProducts() {
-    if (productCount == 0) {
-        printf("No products available.\n");
-        return;
+// analytics [megabytes] [threads]: time the sales report over a synthetic
+// order history with one thread and with several, and check both agree
+int benchAnalytics(int argc, char *argv[]) {
+    int megabytes = argc > 0 ? atoi(argv[0]) : 512;
+#ifndef _WIN32
+    int threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    int threads = 1;
+#endif
+    if (megabytes < 1 || threads < 1 || threads > LOAD_MAX_THREADS) {
+        printf("Usage: project bench analytics [megabytes] [threads, 1..%d]\n", LOAD_MAX_THREADS);
+        return 1;
     }
+    if (!enterBenchDirectory()) return 1;
 
-    printf("\nProduct List:\n");
-    for (int i = 0; i < productCount; i++) {
-        printf("Serial: %d\n", i + 1);
-        printf("Name: %s\n", products[i].name);
-        printf("Category: %s\n", products[i].category);
-        printf("Price: %.2f\n", products[i].price);
-        printf("Discount: %.2f%%\n", products[i].discount);
-        printf("Stock: %d\n", products[i].stock);
-        printf("Rating: %.2f\n", products[i].rating);
-        printf("Reviews: %s\n", products[i].reviews);
-        printf("------------------------\n");
+    double start = nowSeconds();
+    writeBenchHistory(megabytes);
+    printf("generate       %.2f s\n\n", nowSeconds() - start);
+
+    int modes[] = {1, threads};
+    Buffer reports[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    printf("%-8s %12s %10s %10s %10s %12s\n", "threads", "lines", "MB", "seconds", "MB/s", "lines/s");
+    for (int m = 0; m < 2; m++) {
+        SalesReport report;
+        if (!analyzeHistory(modes[m], &report)) return 1;
+        formatSalesReport(&reports[m], &report);
+        printf("%-8d %12lld %10.1f %10.3f %10.1f %12.0f\n", report.threads, report.lines, report.bytes / 1048576.0,
+               report.seconds, report.bytes / 1048576.0 / report.seconds, report.lines / report.seconds);
+        freeSalesReport(&report);
     }
+    int same = reports[0].length == reports[1].length && memcmp(reports[0].data, reports[1].data, reports[0].length) == 0;
+    printf("\n%s\n", same ? "Both reports are identical." : "The reports DIFFER.");
+    free(reports[0].data);
+    free(reports[1].data);
+    return !same;
 }
 
-// Search products by category or price range
-void searchProducts() {
-    int choice = getIntegerInput("Search by:\n1. Category\n2. Price Range\n3. Both\nEnter your choice: ", 1, 3);
+#ifndef _WIN32
+// State shared by the commit benchmark's client threads
+pthread_mutex_t benchStoreLock = PTHREAD_MUTEX_INITIALIZER;
+double benchDeadline = 0;
 
-    if (choice == 1) {
-        char category[50];
-        printf("Enter category to search: ");
-        scanf("%49s", category);
-        printf("\nProducts in category '%s':\n", category);
+// One commit benchmark client: change discounts the way a server session
+// does, under an exclusive lock, and wait for each change to be on disk
+// after releasing it. Counts its commits in *arg.
+void *benchCommitClient(void *arg) {
+    long long *commits = arg;
+    while (nowSeconds() < benchDeadline) {
+        long long logged = commandStarted();
+        pthread_mutex_lock(&benchStoreLock);
+        int slot = benchRandom() % productCount;
+        setProductDiscount(slot, (float)(benchRandom() % 50));
+        pthread_mutex_unlock(&benchStoreLock);
+        long long written = commandFinished();
+        if (written != logged) waitForCommit(written);
+        (*commits)++;
+    }
+    return NULL;
+}
+#endif
 
-        int found = 0;
-        for (int i = 0; i < productCount; i++) {
-            if (strcmp(products[i].category, category) == 0) {
-                printf("Serial: %d\n", i + 1);
-                printf("Name: %s\n", products[i].name);
-                printf("Price: %.2f\n", products[i].price);
-                printf("Discount: %.2f%%\n", products[i].discount);
-                printf("Stock: %d\n", products[i].stock);
-                printf("Rating: %.2f\n", products[i].rating);
-                printf("Reviews: %s\n", products[i].reviews);
-                printf("------------------------\n");
-                found = 1;
-            }
-        }
-        if (!found) printf("No products found in this category.\n");
+// commit [seconds] [clients...]: commits per second and commits per fsync
+// under each sync policy, for each number of concurrent clients
+int benchCommit(int argc, char *argv[]) {
+#ifndef _WIN32
+    double seconds = argc > 0 ? atof(argv[0]) : 1.0;
+    int clients[16] = {1, 4, 16, 64};
+    int clientCounts = 4;
+    if (argc > 1) {
+        clientCounts = 0;
+        for (int i = 1; i < argc && clientCounts < 16; i++) clients[clientCounts++] = atoi(argv[i]);
+    }
+    for (int i = 0; i < clientCounts; i++) {
+        if (clients[i] < 1 || clients[i] > 256) clientCounts = 0;
+    }
+    if (seconds <= 0 || clientCounts == 0) {
+        printf("Usage: project bench commit [seconds] [clients, 1..256 ...]\n");
+        return 1;
+    }
+    if (!enterBenchDirectory()) return 1;
 
-    } else if (choice == 2) {
-        float minPrice = getFloatInput("Enter minimum price: ", 0.0, 1000000.0);
-        float maxPrice = getFloatInput("Enter maximum price: ", minPrice, 1000000.0);
-        printf("\nProducts between %.2f and %.2f:\n", minPrice, maxPrice);
+    generateBenchProducts(10000);
+    coverReservations();
+    openChangeLog();
+    commitsDeferred = 1;
 
-        int found = 0;
-        for (int i = 0; i < productCount; i++) {
-            if (products[i].price >= minPrice && products[i].price <= maxPrice) {
-                printf("Serial: %d\n", i + 1);
-                printf("Name: %s\n", products[i].name);
-                printf("Category: %s\n", products[i].category);
-                printf("Price: %.2f\n", products[i].price);
-                printf("Discount: %.2f%%\n", products[i].discount);
-                printf("Stock: %d\n", products[i].stock);
-                printf("Rating: %.2f\n", products[i].rating);
-                printf("Reviews: %s\n", products[i].reviews);
-                printf("------------------------\n");
-                found = 1;
+    struct {
+        const char *name;
+        int policy;
+        int window;
+    } policies[] = {
+        {"none", SYNC_NONE, 0},
+        {"always", SYNC_ALWAYS, 0},
+        {"group", SYNC_GROUP, 0},
+        {"group 1ms", SYNC_GROUP, 1000},
+        {"group 5ms", SYNC_GROUP, 5000},
+    };
+    printf("%-12s %8s %14s %10s %16s\n", "policy", "clients", "commits/sec", "fsyncs", "commits/fsync");
+    for (int p = 0; p < 5; p++) {
+        syncPolicy = policies[p].policy;
+        syncWindow = policies[p].window;
+        for (int c = 0; c < clientCounts; c++) {
+            pthread_t threads[256];
+            long long commits[256];
+            long long syncs = changeSyncs, total = 0;
+            int started = 0;
+            double start = nowSeconds();
+            benchDeadline = start + seconds;
+            for (int i = 0; i < clients[c]; i++) {
+                commits[i] = 0;
+                if (pthread_create(&threads[i], NULL, benchCommitClient, &commits[i]) == 0) started++;
+                else break;
             }
-        }
-        if (!found) printf("No products found in this price range.\n");
-
-    } else if (choice == 3) {
-        char category[50];
-        printf("Enter category to search: ");
-        scanf("%49s", category);
-        float minPrice = getFloatInput("Enter minimum price: ", 0.0, 1000000.0);
-        float maxPrice = getFloatInput("Enter maximum price: ", minPrice, 1000000.0);
-        printf("\nProducts in category '%s' and between %.2f and %.2f:\n", category, minPrice, maxPrice);
-
-        int found = 0;
-        for (int i = 0; i < productCount; i++) {
-            if (strcmp(products[i].category, category) == 0 &&
-                products[i].price >= minPrice && products[i].price <= maxPrice) {
-                printf("Serial: %d\n", i + 1);
-                printf("Name: %s\n", products[i].name);
-                printf("Price: %.2f\n", products[i].price);
-                printf("Discount: %.2f%%\n", products[i].discount);
-                printf("Stock: %d\n", products[i].stock);
-                printf("Rating: %.2f\n", products[i].rating);
-                printf("Reviews: %s\n", products[i].reviews);
-                printf("------------------------\n");
-                found = 1;
+            for (int i = 0; i < started; i++) {
+                pthread_join(threads[i], NULL);
+                total += commits[i];
             }
+            double elapsed = nowSeconds() - start;
+            syncs = changeSyncs - syncs;
+            printf("%-12s %8d %14.0f %10lld %16.1f\n", policies[p].name, started, total / elapsed, syncs,
+                   syncs > 0 ? (double)total / syncs : 0.0);
         }
-        if (!found) printf("No products found matching these criteria.\n");
     }
+    syncPolicy = SYNC_GROUP;
+    syncWindow = 1000;
+    commitsDeferred = 0;
+    return 0;
+#else
+    (void)argc;
+    (void)argv;
+    printf("This benchmark needs a POSIX system.\n");
+    return 1;
+#endif
 }
 
-// Add product to cart
-void addToCart(char *username) {
-    displayProducts();
-    if (productCount == 0) return;
+// Command-line benchmarks: project bench <name> [args...]
+int runBenchmark(int argc, char *argv[]) {
+    if (argc > 0 && strcmp(argv[0], "search") == 0) {
+        return benchSearch(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "checkout") == 0) {
+        return benchCheckout(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "suite") == 0) {
+        return benchSuite(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "load") == 0) {
+        return benchLoad(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "login") == 0) {
+        return benchLogin(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "text") == 0) {
+        return benchText(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "top") == 0) {
+        return benchTop(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "analytics") == 0) {
+        return benchAnalytics(argc - 1, argv + 1);
+    }
+    if (argc > 0 && strcmp(argv[0], "commit") == 0) {
+        return benchCommit(argc - 1, argv + 1);
+    }
+    printf("Usage: project bench search [sizes...]\n");
+    printf("       project bench checkout [catalog size]\n");
+    printf("       project bench suite [products] [orders]\n");
+    printf("       project bench load [megabytes] [threads]\n");
+    printf("       project bench login [sizes...]\n");
+    printf("       project bench text [sizes...]\n");
+    printf("       project bench top [sizes...]\n");
+    printf("       project bench analytics [megabytes] [threads]\n");
+    printf("       project bench commit [seconds] [clients...]\n");
+    return 1;
+}
 
-    int serial = getIntegerInput("Enter the serial number of the product to add to cart (0 to cancel): ", 0, productCount);
-    if (serial == 0) return;
+// Append formatted text to a buffer, growing it as needed
+void bufferPrintf(Buffer *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0) return;
 
-    int quantity = getIntegerInput("Enter quantity: ", 1, products[serial-1].stock);
+    if (buffer->length + needed + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->length + needed + 1 > capacity) capacity *= 2;
+        char *data = realloc(buffer->data, capacity);
+        if (data == NULL) {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
 
-    if (products[serial - 1].stock >= quantity) {
-        Order newOrder;
-        newOrder.orderId = ++lastOrderId; // Assign a new order ID
-        strncpy(newOrder.username, username, 49);
-        strncpy(newOrder.productName, products[serial - 1].name, 49);
-        newOrder.quantity = quantity;
-        newOrder.totalPrice = products[serial - 1].price * quantity * (1 - products[serial - 1].discount / 100);
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length, needed + 1, format, args);
+    va_end(args);
+    buffer->length += needed;
+}
 
-        printf("Enter your address: ");
-        getchar(); // Clear buffer
-        fgets(newOrder.address, 100, stdin);
-        newOrder.address[strcspn(newOrder.address, "\n")] = 0;
+// Short reason for a failed operation, used in batch responses
+const char *resultReason(int result) {
+    switch (result) {
+        case RESULT_NOT_FOUND: return "not found";
+        case RESULT_EXISTS: return "already exists";
+        case RESULT_INVALID: return "invalid value";
+        case RESULT_NO_STOCK: return "insufficient stock";
+        case RESULT_EMPTY: return "cart is empty";
+        case RESULT_DENIED: return "permission denied";
+    }
+    return "ok";
+}
 
-        strcpy(newOrder.paymentMethod, "Pending");
+// Split the next space-separated word off *line; NULL when none is left
+char *nextToken(char **line) {
+    char *start = *line;
+    while (*start == ' ' || *start == '\t') start++;
+    if (*start == '\0') {
+        *line = start;
+        return NULL;
+    }
+    char *end = start;
+    while (*end != '\0' && *end != ' ' && *end != '\t') end++;
+    if (*end != '\0') *end++ = '\0';
+    *line = end;
+    return start;
+}
 
-        if (orderCount < MAX_ORDERS) {
-            orders[orderCount++] = newOrder;
-            saveOrders();
-            printf("Product added to cart successfully! Order ID: %d\n", newOrder.orderId);
-        } else {
-            printf("Cart is full. Cannot add more items.\n");
-        }
-    } else {
-        printf("Insufficient stock.\n");
+// Everything left on the line without surrounding blanks; NULL if empty
+char *restOfLine(char **line) {
+    char *start = *line;
+    while (*start == ' ' || *start == '\t') start++;
+    size_t length = strlen(start);
+    while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t')) {
+        start[--length] = '\0';
     }
+    *line = start + length;
+    return length > 0 ? start : NULL;
 }
 
-// Checkout and place order
-void checkout(char *username) {
-    float total = 0;
-    printf("\nYour Cart:\n");
+// Parse a whole token as an integer
+int parseInteger(const char *token, int *value) {
+    char *end;
+    if (token == NULL) return 0;
+    long parsed = strtol(token, &end, 10);
+    if (end == token || *end != '\0' || parsed < -2147483647L || parsed > 2147483647L) return 0;
+    *value = (int)parsed;
+    return 1;
+}
 
-    int hasItems = 0;
-    for (int i = 0; i < orderCount; i++) {
-        if (strcmp(orders[i].username, username) == 0 && strcmp(orders[i].paymentMethod, "Pending") == 0) {
-            printf("Order ID: %d\n", orders[i].orderId);
-            printf("Product: %s, Quantity: %d, Total Price: %.2f\n",
-                   orders[i].productName,
-                   orders[i].quantity,
-                   orders[i].totalPrice);
-            total += orders[i].totalPrice;
-            hasItems = 1;
-        }
-    }
+// Parse a whole token as a float
+int parseFloat(const char *token, float *value) {
+    char *end;
+    if (token == NULL) return 0;
+    *value = strtof(token, &end);
+    return end != token && *end == '\0';
+}
 
-    if (!hasItems) {
-        printf("Your cart is empty. No payment required.\n");
-        getchar(); // Wait for user input
-        return;
-    }
+// Write one product as a tab-separated response line
+void bufferProduct(Buffer *out, int slot) {
+    Product *product = productAt(slot);
+    bufferPrintf(out, "product\t%d\t%s\t%s\t%.2f\t%.2f\t%d\t%.2f\t%s\n",
+                 slot + 1,
+                 product->name,
+                 categories[product->category].name,
+                 product->price,
+                 product->discount,
+                 product->stock,
+                 product->rating,
+                 latestReviewText(slot));
+}
 
-    printf("Total Amount: %.2f\n", total);
+// Run one batch command and append its response to out. Commands are the
+// menu operations without prompts; responses start with "ok" or "error",
+// then the command name, then tab-separated fields.
+void executeCommand(Session *session, char *line, Buffer *out) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *command = nextToken(&line);
+    if (command == NULL || command[0] == '#') return;
 
-    // Payment method selection
-    printf("Choose payment method:\n");
-    printf("1. Visa/Mastercard\n");
-    printf("2. Mobile Banking (Bkash/Nagad)\n");
-    printf("3. Cash on Delivery\n");
-    printf("4. Back to Main Menu\n");
-    int paymentChoice = getIntegerInput("Enter your choice: ", 1, 4);
+    int result = RESULT_INVALID;
+    int needsUser = strcmp(command, "add-to-cart") == 0 || strcmp(command, "orders") == 0 ||
+                    strcmp(command, "checkout") == 0 || strcmp(command, "review") == 0;
+    int needsAdmin = strcmp(command, "add-product") == 0 || strcmp(command, "remove-product") == 0 ||
+                     strcmp(command, "discount") == 0;
 
-    if (paymentChoice == 4) {
-        printf("Returning to the main menu...\n");
+    if ((needsUser && (!session->loggedIn || session->isAdmin)) ||
+        (needsAdmin && !session->isAdmin)) {
+        bufferPrintf(out, "error\t%s\t%s\n", command, resultReason(RESULT_DENIED));
         return;
     }
 
-    // Process payment
-    switch (paymentChoice) {
-        case 1: {
-            char accountNumber[20], pin[10];
-            printf("Enter your account number: ");
-            scanf("%19s", accountNumber);
-            printf("Enter your PIN: ");
-            scanf("%9s", pin);
-            printf("Processing payment...\n");
-            printf("Payment Succeed!\n");
-            printf("Your %.2f Taka Paid\n", total);
-
-            // Update payment method for all pending orders
-            for (int i = 0; i < orderCount; i++) {
-                if (strcmp(orders[i].username, username) == 0 && strcmp(orders[i].paymentMethod, "Pending") == 0) {
-                    strncpy(orders[i].paymentMethod, "Visa/Mastercard", 19);
-                    updateStock(orders[i].productName, orders[i].quantity);
-                }
+    if (strcmp(command, "register") == 0) {
+        char *username = nextToken(&line);
+        char *password = nextToken(&line);
+        if (username != NULL && password != NULL &&
+            strlen(username) <= 49 && strlen(password) < PASSWORD_LENGTH) {
+            result = createUser(username, password);
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\tregister\t%s\n", username);
+            return;
+        }
+    } else if (strcmp(command, "login") == 0) {
+        char *username = nextToken(&line);
+        char *password = nextToken(&line);
+        int role = -1;
+        if (username != NULL && password != NULL && strlen(username) <= 49) {
+            role = authenticateUser(username, password);
+        }
+        if (role >= 0) {
+            strcpy(session->username, username);
+            session->loggedIn = 1;
+            session->isAdmin = role;
+            bufferPrintf(out, "ok\tlogin\t%s\t%s\n", username, role ? "admin" : "user");
+            return;
+        }
+        result = RESULT_DENIED;
+    } else if (strcmp(command, "logout") == 0) {
+        session->loggedIn = 0;
+        session->isAdmin = 0;
+        session->username[0] = '\0';
+        bufferPrintf(out, "ok\tlogout\n");
+        return;
+    } else if (strcmp(command, "list") == 0) {
+        // "list LIMIT [AFTER]" returns one page: up to LIMIT products after
+        // serial AFTER, and the serial to continue after (0 at the end)
+        char *limitToken = nextToken(&line);
+        char *afterToken = nextToken(&line);
+        int limit, after = 0;
+        if (limitToken == NULL) {
+            bufferPrintf(out, "ok\tlist\t%d\n", activeProductCount);
+            for (int i = 0; i < productCount; i++) {
+                if (!productAt(i)->deleted) bufferProduct(out, i);
             }
-            break;
+            return;
         }
-        case 2: {
-            int mobileChoice = getIntegerInput("Choose:\n1. Bkash\n2. Nagad\nEnter choice: ", 1, 2);
-            char mobileNumber[15], pin[10];
-            do {
-                printf("Enter your mobile number (11 digits): ");
-                scanf("%14s", mobileNumber);
-            } while (!validateMobileNumber(mobileNumber));
-            printf("Enter your PIN: ");
-            scanf("%9s", pin);
-            printf("Processing payment...\n");
-            printf("Payment Succeed!\n");
-            printf("Your %.2f Taka Paid\n", total);
-
-            // Update payment method for all pending orders
-            for (int i = 0; i < orderCount; i++) {
-                if (strcmp(orders[i].username, username) == 0 && strcmp(orders[i].paymentMethod, "Pending") == 0) {
-                    strncpy(orders[i].paymentMethod, (mobileChoice == 1) ? "Bkash" : "Nagad", 19);
-                    updateStock(orders[i].productName, orders[i].quantity);
+        if (parseInteger(limitToken, &limit) && limit > 0 &&
+            (afterToken == NULL || (parseInteger(afterToken, &after) && after >= 0))) {
+            Buffer rows = {NULL, 0, 0};
+            int count = 0, cursor = after;
+            for (; cursor < productCount && count < limit; cursor++) {
+                if (productAt(cursor)->deleted) continue;
+                bufferProduct(&rows, cursor);
+                count++;
+            }
+            int next = cursor;
+            while (next < productCount && productAt(next)->deleted) next++;
+            bufferPrintf(out, "ok\tlist\t%d\t%d\n", count, next < productCount ? cursor : 0);
+            if (count > 0) bufferPrintf(out, "%s", rows.data);
+            free(rows.data);
+            return;
+        }
+    } else if (strcmp(command, "reviews") == 0) {
+        // "reviews SERIAL LIMIT [BEFORE]" returns one page of a product's
+        // reviews, newest first, older than review BEFORE, then the review
+        // to continue before (0 at the end), the review count and the mean
+        int serial, limit, before = 0;
+        char *beforeToken;
+        if (parseInteger(nextToken(&line), &serial) && parseInteger(nextToken(&line), &limit) && limit > 0 &&
+            ((beforeToken = nextToken(&line)) == NULL || parseInteger(beforeToken, &before))) {
+            if (!isLiveProduct(serial - 1) ||
+                (before != 0 && (before < 0 || before > reviewCount || reviewAt(before - 1)->product != serial - 1))) {
+                result = RESULT_NOT_FOUND;
+            } else {
+                Product *product = productAt(serial - 1);
+                if (limit > product->reviewCount) limit = product->reviewCount;
+                int *page = malloc((limit > 0 ? limit : 1) * sizeof(int));
+                if (page == NULL) {
+                    printf("Out of memory.\n");
+                    exit(EXIT_FAILURE);
                 }
+                int count = pageReviews(serial - 1, before - 1, limit, page);
+                int next = count > 0 && reviewAt(page[count - 1])->previous != -1 ? page[count - 1] + 1 : 0;
+                bufferPrintf(out, "ok\treviews\t%d\t%d\t%d\t%.2f\n", count, next, product->reviewCount, product->rating);
+                for (int i = 0; i < count; i++) {
+                    bufferPrintf(out, "review\t%d\t%.2f\t%s\n", page[i] + 1, reviewAt(page[i])->rating,
+                                 reviewAt(page[i])->text);
+                }
+                free(page);
+                return;
             }
-            break;
         }
-        case 3: {
-            printf("You have chosen Cash on Delivery. Payment will be made upon delivery.\n");
-
-            // Update payment method for all pending orders
-            for (int i = 0; i < orderCount; i++) {
-                if (strcmp(orders[i].username, username) == 0 && strcmp(orders[i].paymentMethod, "Pending") == 0) {
-                    strncpy(orders[i].paymentMethod, "Cash on Delivery", 19);
-                    updateStock(orders[i].productName, orders[i].quantity);
+    } else if (strcmp(command, "search") == 0) {
+        char *mode = nextToken(&line);
+        char *category = NULL;
+        float minPrice = 0, maxPrice = 0;
+        int byPrice = 0, valid = 0;
+        if (mode != NULL && strcmp(mode, "category") == 0) {
+            category = nextToken(&line);
+            valid = category != NULL;
+        } else if (mode != NULL && strcmp(mode, "price") == 0) {
+            byPrice = 1;
+            valid = parseFloat(nextToken(&line), &minPrice) && parseFloat(nextToken(&line), &maxPrice);
+        } else if (mode != NULL && strcmp(mode, "both") == 0) {
+            byPrice = 1;
+            category = nextToken(&line);
+            valid = category != NULL &&
+                    parseFloat(nextToken(&line), &minPrice) && parseFloat(nextToken(&line), &maxPrice);
+        }
+        if (valid) {
+            int *results;
+            int count = findMatchingProducts(category, byPrice, minPrice, maxPrice, &results);
+            bufferPrintf(out, "ok\tsearch\t%d\n", count);
+            for (int i = 0; i < count; i++) bufferProduct(out, results[i]);
+            free(results);
+            return;
+        }
+    } else if (strcmp(command, "filter") == 0) {
+        // "filter MIN MAX [RATING]": in-stock products priced MIN..MAX after
+        // discount and rated at least RATING
+        ProductFilter filter = {-1, 1, 0, 0, 0, 1};
+        char *ratingToken;
+        if (parseFloat(nextToken(&line), &filter.minPrice) && parseFloat(nextToken(&line), &filter.maxPrice) &&
+            ((ratingToken = nextToken(&line)) == NULL || parseFloat(ratingToken, &filter.minRating))) {
+            int *results;
+            int count = filterProducts(&filter, &results);
+            bufferPrintf(out, "ok\tfilter\t%d\n", count);
+            for (int i = 0; i < count; i++) bufferProduct(out, results[i]);
+            free(results);
+            return;
+        }
+    } else if (strcmp(command, "top") == 0) {
+        // "top rated|sellers [K]" or "top cheapest CATEGORY [K]": the first
+        // K entries of a top list. Not shared in server mode, since a read
+        // may rebuild the list.
+        char *kindToken = nextToken(&line);
+        char *category = NULL;
+        int kind = -1, k = TOP_VIEW_SIZE;
+        if (kindToken != NULL && strcmp(kindToken, "rated") == 0) {
+            kind = TOP_RATED;
+        } else if (kindToken != NULL && strcmp(kindToken, "sellers") == 0) {
+            kind = TOP_SELLERS;
+        } else if (kindToken != NULL && strcmp(kindToken, "cheapest") == 0) {
+            category = nextToken(&line);
+            if (category != NULL) kind = TOP_CHEAPEST;
+        }
+        char *limitToken = nextToken(&line);
+        if (kind != -1 && (limitToken == NULL || (parseInteger(limitToken, &k) && k > 0 && k <= TOP_VIEW_SIZE))) {
+            int results[TOP_VIEW_SIZE];
+            int count = topProducts(kind, category, k, results);
+            bufferPrintf(out, "ok\ttop\t%d\n", count);
+            for (int i = 0; i < count; i++) bufferProduct(out, results[i]);
+            return;
+        }
+    } else if (strcmp(command, "find") == 0) {
+        // "find LIMIT WORDS...": the LIMIT best products whose name,
+        // category or reviews match every word; see searchText
+        int limit;
+        char *query;
+        if (parseInteger(nextToken(&line), &limit) && limit > 0 && limit <= TEXT_RESULTS_MAX &&
+            (query = restOfLine(&line)) != NULL) {
+            int results[TEXT_RESULTS_MAX];
+            int count = searchText(query, limit, results);
+            bufferPrintf(out, "ok\tfind\t%d\n", count);
+            for (int i = 0; i < count; i++) bufferProduct(out, results[i]);
+            return;
+        }
+    } else if (strcmp(command, "add-to-cart") == 0) {
+        int serial, quantity, orderId;
+        if (parseInteger(nextToken(&line), &serial) && parseInteger(nextToken(&line), &quantity)) {
+            char *address = restOfLine(&line);
+            if (address != NULL && strlen(address) <= 99) {
+                result = placeInCart(session->username, serial - 1, quantity, address, &orderId);
+            }
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\tadd-to-cart\t%d\n", orderId);
+            return;
+        }
+    } else if (strcmp(command, "orders") == 0) {
+        lockOrders();
+        CustomerOrders *customer = findCustomerOrders(session->username, 0);
+        int count = customer != NULL ? customer->orders.count : 0;
+        bufferPrintf(out, "ok\torders\t%d\n", count);
+        for (int i = 0; i < count; i++) {
+            Order *order = orderAt(customer->orders.slots[i]);
+            bufferPrintf(out, "order\t%d\t%s\t%d\t%.2f\t%s\t%s\n",
+                         order->orderId,
+                         productAt(order->product)->name,
+                         order->quantity,
+                         order->totalPrice,
+                         orderMethod(order),
+                         stringAt(order->address));
+        }
+        unlockOrders();
+        return;
+    } else if (strcmp(command, "checkout") == 0) {
+        static const char *methods[][2] = {
+            {"card", "Visa/Mastercard"},
+            {"bkash", "Bkash"},
+            {"nagad", "Nagad"},
+            {"cod", "Cash on Delivery"}
+        };
+        char *method = nextToken(&line);
+        for (int i = 0; method != NULL && i < 4; i++) {
+            if (strcmp(method, methods[i][0]) == 0) {
+                int items;
+                float total;
+                result = checkoutCart(session->username, methods[i][1], &items, &total);
+                if (result == RESULT_OK) {
+                    bufferPrintf(out, "ok\tcheckout\t%d\t%.2f\n", items, total);
+                    return;
                 }
+                break;
             }
-            break;
         }
+    } else if (strcmp(command, "review") == 0) {
+        int orderId;
+        float rating;
+        if (parseInteger(nextToken(&line), &orderId) && parseFloat(nextToken(&line), &rating)) {
+            char *text = restOfLine(&line);
+            int order = findUserOrder(session->username, orderId);
+            if (order == -1) {
+                result = RESULT_NOT_FOUND;
+            } else if (text != NULL) {
+                result = reviewProduct(orderAt(order)->product, rating, text);
+            }
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\treview\t%d\n", orderId);
+            return;
+        }
+    } else if (strcmp(command, "add-product") == 0) {
+        char *name = nextToken(&line);
+        char *category = nextToken(&line);
+        float price, discount;
+        int stock, slot;
+        if (name != NULL && category != NULL &&
+            parseFloat(nextToken(&line), &price) && parseInteger(nextToken(&line), &stock) &&
+            parseFloat(nextToken(&line), &discount)) {
+            result = createProduct(name, category, price, stock, discount, &slot);
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\tadd-product\t%d\n", slot + 1);
+            return;
+        }
+    } else if (strcmp(command, "remove-product") == 0) {
+        int serial;
+        if (parseInteger(nextToken(&line), &serial)) {
+            result = removeProductAt(serial - 1);
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\tremove-product\t%d\n", serial);
+            return;
+        }
+    } else if (strcmp(command, "discount") == 0) {
+        int serial;
+        float discount;
+        if (parseInteger(nextToken(&line), &serial) && parseFloat(nextToken(&line), &discount)) {
+            result = setProductDiscount(serial - 1, discount);
+        }
+        if (result == RESULT_OK) {
+            bufferPrintf(out, "ok\tdiscount\t%d\t%.2f\n", serial, discount);
+            return;
+        }
+    } else {
+        bufferPrintf(out, "error\t%s\tunknown command\n", command);
+        return;
     }
 
-    // Save to order history and clear pending orders
-    saveOrderHistory();
-    saveOrders();
-    printf("Thank you for your purchase!\n");
+    bufferPrintf(out, "error\t%s\t%s\n", command, resultReason(result));
 }
 
-// Update stock after purchase
-void updateStock(char *productName, int quantity) {
-    for (int i = 0; i < productCount; i++) {
-        if (strcmp(products[i].name, productName) == 0) {
-            products[i].stock -= quantity;
-            if (products[i].stock <= 0) {
-                // Auto delete out-of-stock products
-                for (int j = i; j < productCount - 1; j++) {
-                    products[j] = products[j + 1];
-                }
-                productCount--;
-            }
-            saveProducts();
-            return;
+// Non-interactive mode: project batch [file]. Reads one command per line
+// from file (or standard input) and writes one response per command to
+// standard output, so the store can be scripted and load tested.
+int runBatch(const char *path) {
+    FILE *input = stdin;
+    if (path != NULL) {
+        input = fopen(path, "r");
+        if (input == NULL) {
+            fprintf(stderr, "Cannot open %s\n", path);
+            return 1;
+        }
+    }
+
+    loadData();
+    openChangeLog();
+    // Results are only written out once the changes behind them are on
+    // disk, so one fsync covers every command buffered since the last write
+    commitsDeferred = 1;
+
+    Session session;
+    memset(&session, 0, sizeof(session));
+    Buffer out = {NULL, 0, 0};
+    char line[512];
+    long commands = 0;
+    double start = nowSeconds();
+
+    while (fgets(line, sizeof(line), input) != NULL) {
+        executeCommand(&session, line, &out);
+        commands++;
+        if (out.length > 65536) {
+            waitForCommit(changeSequence);
+            fwrite(out.data, 1, out.length, stdout);
+            out.length = 0;
+        }
+    }
+    waitForCommit(changeSequence);
+    fwrite(out.data, 1, out.length, stdout);
+    fflush(stdout);
+    free(out.data);
+
+    double elapsed = nowSeconds() - start;
+    compactChangeLog();
+    writeStatsFile();
+    if (input != stdin) fclose(input);
+
+    fprintf(stderr, "%ld commands in %.3f s (%.0f ops/sec)\n",
+            commands, elapsed, elapsed > 0 ? commands / elapsed : 0.0);
+    return 0;
+}
+
+// Check whether a batch command can run alongside others holding the store
+// lock shared in server mode: it either only reads the store, or only adds
+// cart items, which reserve stock atomically and take orderLock to append
+int isSharedCommand(const char *line) {
+    static const char *shared[] = {"list", "search", "filter", "find", "reviews", "orders", "login", "logout", "add-to-cart"};
+    while (*line == ' ' || *line == '\t') line++;
+    size_t length = strcspn(line, " \t\r\n");
+    if (length == 0 || line[0] == '#') return 1;
+    for (int i = 0; i < 9; i++) {
+        if (strlen(shared[i]) == length && strncmp(line, shared[i], length) == 0) {
+            return 1;
         }
     }
+    return 0;
 }
 
-// Provide rating and review after checkout
-void provideRatingAndReview(char *username) {
-    displayUserOrders(username);
-    if (orderCount == 0) return;
+#ifndef _WIN32
+// Server mode state. Every session command runs under storeLock: listings,
+// searches and cart additions share it and run in parallel, while
+// anything else that changes the store (and the change log behind it)
+// holds it exclusively, as does compacting the change log.
+pthread_rwlock_t storeLock;
+pthread_mutex_t connectionLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t connectionReady = PTHREAD_COND_INITIALIZER;
+pthread_cond_t connectionSpace = PTHREAD_COND_INITIALIZER;
+int connectionQueue[SERVER_QUEUE];
+int connectionHead = 0;
+int connectionCount = 0;
+volatile sig_atomic_t serverStopping = 0;
+int serverListener = -1;
 
-    int orderId = getIntegerInput("Enter the Order ID you want to review (0 to cancel): ", 0, lastOrderId);
-    if (orderId == 0) return;
+// Ask the accept loop to shut down. Shutting the listener down wakes
+// accept() even if the signal went to a thread other than the accept loop.
+void stopServer(int signalNumber) {
+    (void)signalNumber;
+    serverStopping = 1;
+    if (serverListener != -1) shutdown(serverListener, SHUT_RDWR);
+}
 
-    // Find the product in the order
-    char productToReview[50] = "";
-    for (int i = 0; i < orderCount; i++) {
-        if (orders[i].orderId == orderId && strcmp(orders[i].username, username) == 0) {
-            strcpy(productToReview, orders[i].productName);
-            break;
+// Write all of data to a socket
+int writeAll(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 0;
         }
+        data += written;
+        length -= written;
     }
+    return 1;
+}
 
-    if (strlen(productToReview) == 0) {
-        printf("Order ID not found or doesn't belong to you.\n");
+// Run batch commands from one client until it disconnects
+void serveConnection(int fd) {
+    FILE *input = fdopen(fd, "r");
+    if (input == NULL) {
+        close(fd);
         return;
     }
 
-    // Find the product in products
-    for (int i = 0; i < productCount; i++) {
-        if (strcmp(products[i].name, productToReview) == 0) {
-            float rating = getFloatInput("Enter your rating (0-5): ", 0.0, 5.0);
-            printf("Enter your review: ");
-            getchar(); // Clear buffer
-            fgets(products[i].reviews, 100, stdin);
-            products[i].reviews[strcspn(products[i].reviews, "\n")] = 0;
-            products[i].rating = rating;
-
-            saveProducts();
-            printf("Thank you for your feedback!\n");
-            return;
+    Session session;
+    memset(&session, 0, sizeof(session));
+    Buffer out = {NULL, 0, 0};
+    char line[512];
+
+    while (fgets(line, sizeof(line), input) != NULL) {
+        long long logged = commandStarted();
+        if (isSharedCommand(line)) {
+            pthread_rwlock_rdlock(&storeLock);
+        } else {
+            pthread_rwlock_wrlock(&storeLock);
+        }
+        executeCommand(&session, line, &out);
+        pthread_rwlock_unlock(&storeLock);
+        if (__atomic_load_n(&changeLogBytes, __ATOMIC_RELAXED) >= CHANGE_LOG_COMPACT_BYTES) {
+            pthread_rwlock_wrlock(&storeLock);
+            compactChangeLogIfDue();
+            pthread_rwlock_unlock(&storeLock);
         }
-    }
 
-    printf("Product not found.\n");
+        // Answer once the command's changes are on disk. Waiting outside
+        // the lock lets the commands queued behind it share the fsync.
+        long long written = commandFinished();
+        if (written != logged) waitForCommit(written);
+
+        if (!writeAll(fd, out.data, out.length)) break;
+        out.length = 0;
+    }
+    free(out.data);
+    fclose(input);
 }
 
-// Validate mobile number (11 digits, starting with 018/019/017/013/014/015/016)
-int validateMobileNumber(char *number) {
-    if (strlen(number) != 11) {
-        printf("Mobile number must be 11 digits.\n");
-        return 0;
+// Worker thread: take accepted connections off the queue and serve them
+void *serverWorker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&connectionLock);
+        while (connectionCount == 0) {
+            pthread_cond_wait(&connectionReady, &connectionLock);
+        }
+        int fd = connectionQueue[connectionHead];
+        connectionHead = (connectionHead + 1) % SERVER_QUEUE;
+        connectionCount--;
+        pthread_cond_signal(&connectionSpace);
+        pthread_mutex_unlock(&connectionLock);
+
+        serveConnection(fd);
     }
+    return NULL;
+}
 
-    for (int i = 0; i < 11; i++) {
-        if (!isdigit(number[i])) {
-            printf("Mobile number must contain only digits.\n");
-            return 0;
+// Listen on a Unix socket if address is a path, otherwise on a loopback
+// TCP port. Returns the listening socket or -1.
+int openListener(const char *address) {
+    int fd;
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(local.sun_path)) return -1;
+        strcpy(local.sun_path, address);
+        unlink(address);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) return -1;
+        if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        int port = atoi(address);
+        if (port < 1 || port > 65535) return -1;
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_port = htons(port);
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1) return -1;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0) {
+            close(fd);
+            return -1;
         }
     }
+    if (listen(fd, SERVER_QUEUE) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
 
-    char prefix[4];
-    strncpy(prefix, number, 3);
-    prefix[3] = '\0';
-    const char *validPrefixes[] = {"018", "019", "017", "013", "014", "015", "016"};
+// Server mode: project serve [port | socket path] [threads]. Clients speak
+// the batch protocol, one session per connection, served by a fixed pool
+// of worker threads. SIGINT or SIGTERM stops the server after compacting
+// the change log.
+int runServer(int argc, char *argv[]) {
+#ifndef _WIN32
+    char defaultPort[16];
+    sprintf(defaultPort, "%d", SERVER_PORT);
+    const char *address = argc > 0 ? argv[0] : defaultPort;
+    int threads = argc > 1 ? atoi(argv[1]) : SERVER_THREADS;
+    if (threads < 1) {
+        printf("Usage: project serve [port | socket path] [threads]\n");
+        return 1;
+    }
 
-    for (int i = 0; i < 7; i++) {
-        if (strcmp(prefix, validPrefixes[i]) == 0) {
+    loadData();
+    openChangeLog();
+    commitsDeferred = 1;
+    compactionDeferred = 1;
+    // Text searches share the store lock, so the index they build on first
+    // use has to exist before any session starts
+    buildTextIndex();
+
+    // Prefer writers so a steady stream of searches cannot starve checkouts
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&storeLock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+
+    int listener = openListener(address);
+    if (listener == -1) {
+        printf("Cannot listen on %s\n", address);
+        return 1;
+    }
+    serverListener = listener;
+
+    // Interrupt accept() on shutdown instead of restarting it
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Workers start with SIGINT and SIGTERM blocked, so the signals go to
+    // this thread and interrupt its accept()
+    sigset_t stopSignals, previous;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serverWorker, NULL) != 0) {
+            printf("Cannot start worker threads.\n");
             return 1;
         }
+        pthread_detach(thread);
     }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    printf("Serving on %s with %d threads\n", address, threads);
+    fflush(stdout);
 
-    printf("Mobile number must start with 018, 019, 017, 013, 014, 015, or 016.\n");
+    while (!serverStopping) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd == -1) continue;
+
+        pthread_mutex_lock(&connectionLock);
+        while (connectionCount == SERVER_QUEUE) {
+            pthread_cond_wait(&connectionSpace, &connectionLock);
+        }
+        connectionQueue[(connectionHead + connectionCount) % SERVER_QUEUE] = fd;
+        connectionCount++;
+        pthread_cond_signal(&connectionReady);
+        pthread_mutex_unlock(&connectionLock);
+    }
+
+    // Wait for commands in flight, then leave the store compacted
+    pthread_rwlock_wrlock(&storeLock);
+    serverListener = -1;
+    close(listener);
+    if (strchr(address, '/') != NULL) unlink(address);
+    compactChangeLog();
+    writeStatsFile();
+    printf("Server stopped.\n");
     return 0;
+#else
+    (void)argc;
+    (void)argv;
+    printf("Server mode needs a POSIX system.\n");
+    return 1;
+#endif
 }
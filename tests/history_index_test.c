@@ -0,0 +1,61 @@
+// Indexing of order history lines longer than the line buffer.
+//
+// Build and run from the repository root:
+//   cc -pthread tests/history_index_test.c -o history_index_test && ./history_index_test
+
+// project.c is a single translation unit with its own main
+#define main projectMain
+#include "../project.c"
+#undef main
+
+int failures = 0;
+
+// Report a failed check
+void expect(int condition, const char *what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+int main() {
+    if (!enterBenchDirectory()) return 1;
+
+    // A line well past the 500-byte read buffer between two short ones
+    char address[1200];
+    memset(address, 'x', sizeof(address) - 1);
+    address[sizeof(address) - 1] = '\0';
+    FILE *history = fopen(FILENAME_ORDER_HISTORY, "wb");
+    if (history == NULL) return 1;
+    int lengths[3];
+    lengths[0] = fprintf(history, "Order ID: 1, Date: 2024-01-02 10:00:00, User: a, Product: Mango, Qty: 1, Total: 5.00, Method: Bkash, Address: Road 1\n");
+    lengths[1] = fprintf(history, "Order ID: 2, Date: 2024-01-03 10:00:00, User: b, Product: Mango, Qty: 1, Total: 5.00, Method: Bkash, Address: %s\n", address);
+    lengths[2] = fprintf(history, "Order ID: 3, Date: 2024-01-04 10:00:00, User: c, Product: Mango, Qty: 1, Total: 5.00, Method: Nagad, Address: Road 3\n");
+    fclose(history);
+
+    loadLastSavedOrderId();
+    expect(lastSavedOrderId == 3, "last saved order ID comes from the last line");
+
+    FILE *index = fopen(FILENAME_HISTORY_INDEX, "rb");
+    expect(index != NULL, "index file exists");
+    if (index != NULL) {
+        expect(historyEntryCount(index) == 3, "one index entry per history line");
+        long long offset = 0;
+        for (int i = 0; i < 3; i++) {
+            HistoryIndexEntry entry;
+            if (!readHistoryEntry(index, i, &entry)) {
+                expect(0, "index entry can be read");
+                continue;
+            }
+            expect(entry.orderId == i + 1, "entry has its line's order ID");
+            expect(entry.offset == offset, "entry starts where its line starts");
+            expect(entry.length == lengths[i], "entry covers its whole line");
+            expect(entry.timestamp != 0, "entry has its line's date");
+            offset += lengths[i];
+        }
+        fclose(index);
+    }
+
+    printf("%s\n", failures == 0 ? "history index test passed" : "history index test FAILED");
+    return failures == 0 ? 0 : 1;
+}